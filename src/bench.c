@@ -0,0 +1,140 @@
+/*
+ * WyldChess, a free UCI/Xboard compatible chess engine
+ * Copyright (C) 2016-2017 Manik Charan
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "search.h"
+#include "engine.h"
+
+// Middlegames and endgames of varying sharpness, the node total works as a search signature
+static char const * const bench_fens[] = {
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+	"r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+	"r1bq1rk1/pp2bppp/2n1pn2/2pp4/2PP4/2N1PN2/PP2BPPP/R1BQ1RK1 w - - 0 8",
+	"r2q1rk1/1b1nbppp/p2ppn2/1p6/3NP3/1BN1BP2/PPPQ2PP/2KR3R w - - 0 12",
+	"2rq1rk1/pb1nbppp/1p2pn2/2pp4/2PP4/1PNBPN2/PB3PPP/2RQ1RK1 w - - 0 12",
+	"r1b2rk1/2q1bppp/p2ppn2/1p6/3BP3/2NB4/PPP2PPP/R2Q1RK1 w - - 0 13",
+	"3r1rk1/p4ppp/1pn1b3/2p1P3/2P5/2N1B3/PP3PPP/3R1RK1 w - - 0 18",
+	"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+	"4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+	"r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+	"6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - - 0 1",
+	"3b4/5kp1/1p1p1p1p/pP1PpP1P/P1P1P3/3KN3/8/8 w - - 0 1",
+	"2K5/p7/7P/5pR1/8/5k2/r7/8 w - - 0 1",
+	"8/6pk/1p6/8/PP3p1p/5P2/4KP1q/3Q4 w - - 0 1",
+	"8/8/1p1r1k2/p1pPN1p1/P3KnP1/1P6/8/3R4 b - - 0 1",
+	"5k2/7R/4P2p/5K2/p1r2P1p/8/8/8 b - - 0 1",
+	"8/3k4/8/8/8/4B3/4KB2/2B5 w - - 0 1",
+};
+
+// Positions with many captures and long exchanges on the same square
+static char const * const see_fens[] = {
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+	"r1bq1rk1/pp2bppp/2n1pn2/2pp4/2PP4/2N1PN2/PP2BPPP/R1BQ1RK1 w - - 0 8",
+	"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+	"2r2rk1/1bqnbppp/p2ppn2/1p6/3NP3/1BN1BP2/PPPQ2PP/1K1R3R w - - 0 14",
+	"r2qr1k1/pb1n1ppp/1p1bpn2/2pp4/2PP4/1P1BPN2/PB1N1PPP/R2QR1K1 b - - 0 12",
+	"2kr3r/ppp2ppp/2n1bn2/2bqp3/3pP3/2PP1N2/PPBN1PPP/R1BQR1K1 b - - 0 11",
+	"r1b1k2r/pp1nqppp/2p1pn2/3p4/1bPP4/2NBPN2/PP3PPP/R1BQ1RK1 w kq - 0 8",
+	"3rr1k1/pp3ppp/2n1bq2/3p4/3P1B2/2PB1Q2/P4PPP/R3R1K1 w - - 0 18",
+};
+
+#define BENCH_DEPTH (12)
+#define SEE_BENCH_PASSES (200000)
+
+// Fixed depth searches on a single thread, the total node count changes only when the search does
+void bench(struct Engine* const engine, u32 depth)
+{
+	struct Controller* ctlr = calloc(1, sizeof(struct Controller));
+	struct SearchUnit* su   = calloc(1, sizeof(struct SearchUnit));
+	struct SearchStack* ss  = calloc(MAX_PLY, sizeof(struct SearchStack));
+	ctlr->depth      = depth ? depth : BENCH_DEPTH;
+	ctlr->tt         = engine->ctlr.tt;
+	ctlr->pt         = engine->ctlr.pt;
+	su->ctlr         = ctlr;
+	su->id           = 0;
+	su->type         = MAIN;
+	su->protocol     = NO_PROTOCOL;
+	su->target_state = THINKING;
+	alloc_search_locals(&su->sl);
+
+	u64 total_nodes = 0, total_time = 0, start, time, nodes;
+	int score;
+	u32 i, move;
+	char mstr[6];
+	for (i = 0; i != arr_len(bench_fens); ++i) {
+		init_pos(&su->pos);
+		set_pos(&su->pos, (char*) bench_fens[i]);
+		tt_clear(ctlr->tt);
+		init_search(&su->sl);
+		start = curr_time();
+		move  = search_silent(su, ss, &score);
+		time  = curr_time() - start;
+		nodes = total_nodes_searched(ctlr);
+		move_str(&su->pos, move, mstr);
+		fprintf(stdout, "info string position %2u bestmove %-5s score %6d nodes %10llu time %6llu\n",
+			i + 1, mstr, score, nodes, time);
+		total_nodes += nodes;
+		total_time  += time;
+	}
+	fprintf(stdout, "info string Bench depth %u positions %u\n", ctlr->depth, i);
+	fprintf(stdout, "%llu nodes %llu nps\n", total_nodes, total_nodes * 1000 / max(total_time, 1));
+
+	destroy_search_locals(&su->sl);
+	free(ss);
+	free(su);
+	free(ctlr);
+}
+
+// Returns the time taken, the pass count is printed so that both functions can be checked for agreement
+static u64 see_bench_pass(struct Position const * const pos, u32 const * const moves, u32 num, int use_see_ge)
+{
+	static int const thresholds[] = { -200, 0, 200 };
+	u64 passed = 0, start = curr_time();
+	u32 pass, i, t;
+	for (pass = 0; pass != SEE_BENCH_PASSES; ++pass)
+		for (i = 0; i != num; ++i)
+			for (t = 0; t != arr_len(thresholds); ++t)
+				passed += use_see_ge ? see_ge(pos, moves[i], thresholds[t])
+						     : see(pos, moves[i]) >= thresholds[t];
+	u64 time = curr_time() - start;
+	fprintf(stdout, "info string %-6s passed %8llu time %6llu\n", use_see_ge ? "see_ge" : "see", passed, time);
+	return time;
+}
+
+// Times the full swap list against the threshold test over every capture of the SEE positions
+void see_bench()
+{
+	struct Position* pos = malloc(sizeof(struct Position));
+	struct Movelist list;
+	u64 see_time = 0, see_ge_time = 0, calls = 0;
+	u32 i, num;
+	for (i = 0; i != arr_len(see_fens); ++i) {
+		init_pos(pos);
+		set_pos(pos, (char*) see_fens[i]);
+		list.end = list.moves;
+		gen_captures(pos, &list);
+		num = list.end - list.moves;
+		fprintf(stdout, "info string position %u captures %u\n", i + 1, num);
+		see_time    += see_bench_pass(pos, list.moves, num, 0);
+		see_ge_time += see_bench_pass(pos, list.moves, num, 1);
+		calls       += SEE_BENCH_PASSES * num * 3;
+	}
+	fprintf(stdout, "see %llu ns/call see_ge %llu ns/call\n",
+		see_time * 1000000 / max(calls, 1), see_ge_time * 1000000 / max(calls, 1));
+	free(pos);
+}
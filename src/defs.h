@@ -42,9 +42,11 @@
 #define INITIAL_POSITION (("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"))
 
 #define MAX_THREADS        (64)
+#define MAX_MULTIPV        (64)
 #define MAX_MOVES_PER_GAME (2048)
 #define MAX_MOVES_PER_POS  (218)
 #define MAX_PLY            (127)
+#define MAX_FEN_LEN        (128)
 #define BB(x)              (1ULL << (x))
 #define INFINITY           (30000)
 #define MATE               (29000)
@@ -63,6 +65,8 @@
 #define PROM_TYPE_MASK (7 << PROM_TYPE_SHIFT)
 #define CAP_TYPE_MASK  (7 << CAP_TYPE_SHIFT)
 
+typedef unsigned char      u8;
+typedef unsigned short     u16;
 typedef unsigned int       u32;
 typedef unsigned long long u64;
 
@@ -163,6 +167,7 @@ enum MoveOrder {
 	KILLER    = 2800000,
 	COUNTER   = 2700000,
 	NGOOD_CAP = 2600000,
+	QUIET_MAX = 1000000  // Ordered by history only below this
 };
 
 static inline int max(int a, int b) { return a > b ? a : b; }
@@ -0,0 +1,225 @@
+/*
+ * WyldChess, a free UCI/Xboard compatible chess engine
+ * Copyright (C) 2016-2017 Manik Charan
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "engine.h"
+#include "eval_terms.h"
+#include "magicmoves.h"
+
+#define ENGINE_PT_MB (8)
+
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+// Never changed after this, so the engines share them
+static void init_tables()
+{
+	init_timer();
+	init_genrand64(234702970592742ULL);
+	init_zobrist_keys();
+	initmagicmoves();
+	init_lookups();
+	init_eval_terms();
+	init_reductions();
+}
+
+struct Engine* wc_create(unsigned int hash_mb)
+{
+	pthread_once(&tables_once, init_tables);
+	struct Engine* engine = calloc(1, sizeof(struct Engine));
+	if (!engine)
+		return NULL;
+	tt_alloc_MB(&engine->tt, hash_mb);
+	pt_alloc_MB(&engine->pt, ENGINE_PT_MB);
+	engine->ctlr.tt     = &engine->tt;
+	engine->ctlr.pt     = &engine->pt;
+	engine->ctlr.engine = engine;
+	for (int i = 0; i != NUM_OPTIONS; ++i)
+		engine->options[i] = spin_options[i].default_val;
+
+	if (!resize_units(engine, 1)) {
+		pt_destroy(&engine->pt);
+		tt_destroy(&engine->tt);
+		free(engine);
+		return NULL;
+	}
+	struct SearchUnit* su = engine->units[0];
+	init_search_unit(su, &engine->ctlr);
+	su->protocol       = LIBRARY;
+	su->ponder_allowed = 0;
+	return engine;
+}
+
+void wc_destroy(struct Engine* engine)
+{
+	pthread_cond_destroy(&engine->units[0]->sleep_cv);
+	pthread_mutex_destroy(&engine->units[0]->mutex);
+	resize_units(engine, 0);
+	pt_destroy(&engine->pt);
+	tt_destroy(&engine->tt);
+	free(engine);
+}
+
+int wc_set_option(struct Engine* engine, char const* name, int value)
+{
+	if (!strcmp(name, "Hash")) {
+		if (value < 1 || value > 1048576)
+			return 0;
+		tt_alloc_MB(&engine->tt, value);
+		return 1;
+	}
+	if (!strcmp(name, "UCI_Chess960")) {
+		if (value != 0 && value != 1)
+			return 0;
+		engine->is_frc = value;
+		return 1;
+	}
+	for (int i = 0; i != NUM_OPTIONS; ++i) {
+		struct SpinOption const * const option = spin_options + i;
+		if (!strcmp(name, option->name)) {
+			if (value < option->min_val || value > option->max_val)
+				return 0;
+			engine->options[i] = value;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void wc_new_game(struct Engine* engine)
+{
+	for (int i = 0; i != engine->num_units; ++i)
+		init_search(&engine->units[i]->sl);
+	tt_clear(&engine->tt);
+	pt_clear(&engine->pt);
+}
+
+char const* wc_set_position(struct Engine* engine, char const* fen, char const* moves)
+{
+	struct Position* const pos = &engine->units[0]->pos;
+	char const* error = NULL;
+	init_pos(pos);
+	pos->is_frc = engine->is_frc;
+	if (!fen)
+		set_pos(pos, INITIAL_POSITION);
+	else
+		error = set_pos_checked(pos, fen);
+	if (!error)
+		error = play_moves(pos, moves);
+	if (error) {
+		init_pos(pos);
+		pos->is_frc = engine->is_frc;
+		set_pos(pos, INITIAL_POSITION);
+	}
+	return error;
+}
+
+int wc_search(struct Engine* engine, struct WCLimits const* limits,
+	      void (*info)(struct WCInfo const* info, void* data), void* data, char bestmove[6])
+{
+	struct SearchUnit* const su   = engine->units[0];
+	struct Controller* const ctlr = &engine->ctlr;
+	ctlr->depth             = limits->depth && limits->depth < MAX_PLY ? limits->depth : MAX_PLY;
+	ctlr->max_nodes         = limits->nodes;
+	ctlr->mate_moves        = 0;
+	ctlr->analyzing         = 0;
+	ctlr->time_dependent    = limits->movetime > 0;
+	ctlr->soft_time         = 0;
+	ctlr->search_start_time = curr_time();
+	ctlr->search_end_time   = ctlr->search_start_time + limits->movetime;
+	engine->info            = info;
+	engine->info_data       = data;
+	su->limited_moves_num   = 0;
+	su->curr_state          = THINKING;
+	su->target_state        = THINKING;
+
+	u32 move = begin_search(su);
+	su->target_state = WAITING;
+	su->curr_state   = WAITING;
+	if (move)
+		move_str(&su->pos, move, bestmove);
+	else
+		strcpy(bestmove, "0000");
+	return engine->pv_lines[0].val;
+}
+
+void wc_stop(struct Engine* engine)
+{
+	engine->units[0]->target_state = WAITING;
+}
+
+// Units and stacks of the helpers follow the Threads option, begin_search resizes them before starting
+// the helpers. Returns the number of units, fewer than asked for when out of memory.
+int resize_units(struct Engine* const engine, int num_units)
+{
+	int i;
+	while (engine->num_units > num_units) {
+		i = --engine->num_units;
+		destroy_search_locals(&engine->units[i]->sl);
+		free(engine->units[i]);
+		free(engine->stacks[i]);
+		engine->units[i]  = NULL;
+		engine->stacks[i] = NULL;
+	}
+	while (engine->num_units < num_units) {
+		i = engine->num_units;
+		engine->units[i]  = calloc(1, sizeof(struct SearchUnit));
+		engine->stacks[i] = calloc(MAX_PLY, sizeof(struct SearchStack));
+		if (   !engine->units[i]
+		    || !engine->stacks[i]
+		    || alloc_search_locals(&engine->units[i]->sl)) {
+			free(engine->units[i]);
+			free(engine->stacks[i]);
+			engine->units[i]  = NULL;
+			engine->stacks[i] = NULL;
+			break;
+		}
+		++engine->num_units;
+	}
+	return engine->num_units;
+}
+
+// Called by begin_search after each iteration of a LIBRARY search
+void report_info(struct SearchUnit const * const su, int depth, int num_lines)
+{
+	struct Controller const * const ctlr = su->ctlr;
+	struct Engine const * const engine   = ctlr->engine;
+	if (!engine->info)
+		return;
+
+	char pv[MAX_PLY * 6];
+	char mstr[6];
+	struct WCInfo info;
+	info.depth    = depth;
+	info.seldepth = su->max_searched_ply;
+	info.nodes    = total_nodes_searched(ctlr);
+	info.time     = curr_time() - ctlr->search_start_time;
+	info.pv       = pv;
+	for (int i = 0; i != num_lines; ++i) {
+		struct PVLine const * const line = engine->pv_lines + i;
+		info.multipv = i + 1;
+		info.score   = line->val;
+		info.mate    = abs(line->val) < MAX_MATE_VAL ? 0
+			     : line->val < 0 ? (-line->val - MATE) / 2 : (-line->val + MATE + 1) / 2;
+		char* end = pv;
+		*end = '\0';
+		for (int j = 0; j != line->pv_depth; ++j) {
+			move_str(&su->pos, line->pv[j], mstr);
+			end += sprintf(end, j ? " %s" : "%s", mstr);
+		}
+		engine->info(&info, engine->info_data);
+	}
+}
@@ -0,0 +1,74 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+/*
+ * WyldChess, a free UCI/Xboard compatible chess engine
+ * Copyright (C) 2016-2017 Manik Charan
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "search_unit.h"
+#include "options.h"
+#include "tt.h"
+#include "pt.h"
+#include "wyldchess.h"
+
+// Everything a search changes belongs to one engine instance. The lookup tables, magics, Zobrist keys
+// and eval parameters are set up once and shared by all the instances.
+struct Engine
+{
+	struct Controller ctlr;
+	struct TT tt;
+	struct PT pt;
+	int options[NUM_OPTIONS];  // Current values of the spin options
+	int is_frc;                // UCI_Chess960, given to each position set up by the engine
+	pthread_t threads[MAX_THREADS];
+	int num_units;                            // Allocated by resize_units, one per search thread
+	struct SearchUnit* units[MAX_THREADS];    // The first one is the main thread of begin_search
+	struct SearchStack* stacks[MAX_THREADS];  // MAX_PLY entries for each unit
+	struct SearchParams params[MAX_THREADS];
+	struct PVLine pv_lines[MAX_MULTIPV];
+	void (*info)(struct WCInfo const * const info, void* data);  // Iterations of a LIBRARY search
+	void* info_data;
+};
+
+extern int resize_units(struct Engine* const engine, int num_units);
+extern void report_info(struct SearchUnit const * const su, int depth, int num_lines);
+
+static inline void start_thinking(struct SearchUnit* const su)
+{
+	struct Controller* const ctlr = su->ctlr;
+	u64 const overhead = ctlr->engine->options[MOVE_OVERHEAD] + ctlr->latency.estimate;
+	u64 const clock    = ctlr->time_left;
+	ctlr->search_start_time = curr_time();
+	ctlr->time_left += (ctlr->moves_left - 1) * ctlr->increment;
+
+	// The share of this move is what the search aims for, the hard limit leaves room to extend
+	// unclear moves without spending a large part of the clock. The last move before a time control
+	// and a movetime search use all of their time.
+	u64 optimum = ctlr->time_left / ctlr->moves_left;
+	u64 hard    = ctlr->moves_left == 1 ? optimum : min(optimum * tm_hard_ratio, clock / 3);
+	optimum     = min(optimum, hard);
+	ctlr->search_end_time = ctlr->search_start_time + (hard > overhead ? hard - overhead : 1);
+	ctlr->soft_time       = ctlr->moves_left == 1 ? 0 : optimum > overhead ? optimum - overhead : 1;
+	transition(su, THINKING);
+	if (ctlr->moves_per_session) {
+		--ctlr->moves_left;
+		if (ctlr->moves_left < 1)
+			ctlr->moves_left = ctlr->moves_per_session;
+	}
+}
+
+#endif
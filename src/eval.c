@@ -27,19 +27,48 @@ struct Eval
 	u64 king_danger_zone_bb[2];
 	u64 pinned_bb[2];
 	u64 passed_pawn_bb[2];
+	u64 outpost_bb[2];
 	int king_atk_pressure[2];
 	int eval[2];
+	struct EvalParams const* ep;
+	struct PT* pt;
+	struct EvalTrace* trace;
 };
 
-int piece_val[8] = {
-	0,
-	0,
-	S(90, 100),
-	S(400, 320),
-	S(400, 330),
-	S(600, 550),
-	S(1200, 1000),
-	S(0, 0)
+struct EvalParams eval_params = {
+	.piece_val = {
+		0,
+		0,
+		S(90, 100),
+		S(400, 320),
+		S(400, 330),
+		S(600, 550),
+		S(1200, 1000),
+		S(0, 0)
+	},
+
+	// King terms
+	.king_atk_wt        = { 0, 0, 0, 3, 3, 4, 5 },
+	.king_shelter_close = S(20, 10),
+	.king_shelter_far   = S(10, 5),
+	.pawn_storm_close   = S(-15, -5),
+	.pawn_storm_far     = S(-8, -3),
+
+	// Pawn structure
+	.doubled_pawns      = S(-10, -10),
+	.isolated_pawn      = S(-10, -10),
+	.backward_pawn      = S(-6, -8),
+	.connected_pawn     = S(5, 5),
+
+	// Mobility terms
+	.mobility           = { 0, 0, 0, 8, 5, 5, 4 },
+
+	// Miscellaneous terms
+	.bishop_pair        = S(50, 80),
+	.rook_on_7th        = S(40, 20),
+	.rook_open_file     = S(20, 20),
+	.rook_semi_open     = S(5, 5),
+	.outpost            = { S(10, 5), S(20, 10) } // Bishop, Knight
 };
 
 int psqt[2][8][64];
@@ -123,9 +152,6 @@ int king_atk_table[100] = { // Taken from CPW(Glaurung 1.2)
 	650, 650, 650, 650, 650, 650, 650, 650, 650, 650,
 	650, 650, 650, 650, 650, 650, 650, 650, 650, 650
 };
-int king_atk_wt[7] = { 0, 0, 0, 3, 3, 4, 5 };
-int king_shelter_close = S(20, 10);
-int king_shelter_far = S(10, 5);
 
 // Pawn structure
 int passed_pawn[3][7] = {
@@ -137,20 +163,10 @@ int passed_pawn[3][7] = {
 	// Square in front of passed pawn is not attacked
 	{ 0, S(5, 5), S(10, 10), S(15, 25), S(40, 60), S(70, 100), S(150, 180) }
 };
-int doubled_pawns = S(-10, -10);
-int isolated_pawn = S(-10, -10);
 
 // Mobility terms
-int mobility[7]      = { 0, 0, 0, 8, 5, 5, 4 };
 int min_mob_count[7] = { 0, 0, 0, 4, 4, 4, 7 };
 
-// Miscellaneous terms
-int bishop_pair    = S(50, 80);
-int rook_on_7th    = S(40, 20);
-int rook_open_file = S(20, 20);
-int rook_semi_open = S(5, 5);
-int outpost[2]     = { S(10, 5), S(20, 10) }; // Bishop, Knight
-
 void init_eval_terms()
 {
 	// Initialize the psqts
@@ -176,54 +192,128 @@ void init_eval_terms()
 	}
 }
 
+static inline void trace_add(struct Eval* const ev, int term, int c, int count)
+{
+	if (ev->trace) {
+		ev->trace->coeffs[term][0] += c == WHITE ? count : -count;
+		ev->trace->coeffs[term][1] += c == WHITE ? count : -count;
+	}
+}
+
+static inline int king_shelter(struct EvalParams const * const ep, u64 pawn_bb, u64 enemy_pawn_bb, int ksq, int c)
+{
+	u64 far_mask = king_shelter_far_mask[c][ksq];
+	return popcnt(pawn_bb & king_shelter_close_mask[c][ksq]) * ep->king_shelter_close
+	     + popcnt(pawn_bb & far_mask) * ep->king_shelter_far
+	     + popcnt(enemy_pawn_bb & far_mask) * ep->pawn_storm_close
+	     + popcnt(enemy_pawn_bb & pawn_shift(far_mask, c)) * ep->pawn_storm_far;
+}
+
+static void eval_king_shelter(struct Position* const pos, struct Eval* const ev, struct PTEntry const * const entry)
+{
+	int c, ksq;
+	for (c = WHITE; c <= BLACK; ++c) {
+		ksq = king_sq(pos, c);
+		// Use the cached value for the king on its back rank, compute it otherwise
+		ev->eval[c] += rank_of(ksq) == rank_lookup[c][RANK_1]
+			     ? entry->king_shelter[c][file_of(ksq)]
+			     : king_shelter(ev->ep, ev->pawn_bb[c], ev->pawn_bb[!c], ksq, c);
+
+		if (ev->trace) {
+			u64 far_mask = king_shelter_far_mask[c][ksq];
+			trace_add(ev, KING_SHELTER_CLOSE, c, popcnt(ev->pawn_bb[c] & king_shelter_close_mask[c][ksq]));
+			trace_add(ev, KING_SHELTER_FAR, c, popcnt(ev->pawn_bb[c] & far_mask));
+			trace_add(ev, PAWN_STORM_CLOSE, c, popcnt(ev->pawn_bb[!c] & far_mask));
+			trace_add(ev, PAWN_STORM_FAR, c, popcnt(ev->pawn_bb[!c] & pawn_shift(far_mask, c)));
+		}
+	}
+}
+
 static void eval_pawns(struct Position* const pos, struct Eval* const ev)
 {
 	STATS(++pos->stats.pawn_probes);
-	struct PTEntry entry = pt_probe(&pt, pos->state->pawn_key);
-	if ((entry.key ^ entry.pawn_atks_white_bb ^ entry.pawn_atks_black_bb) == pos->state->pawn_key) {
+	struct EvalParams const * const ep = ev->ep;
+	struct PTEntry entry;
+	// Tracing needs the individual pawn terms so the table is not used
+	if (ev->pt)
+		entry = pt_probe(ev->pt, pos->state->pawn_key);
+	if (    ev->pt
+	    && (entry.key ^ entry.pawn_atks_bb[WHITE] ^ entry.pawn_atks_bb[BLACK]) == pos->state->pawn_key) {
 		STATS(++pos->stats.pawn_hits);
-		ev->eval[WHITE] += entry.score_white;
-		ev->eval[BLACK] += entry.score_black;
-		ev->atks_bb[WHITE][PAWN] = entry.pawn_atks_white_bb;
-		ev->atks_bb[BLACK][PAWN] = entry.pawn_atks_black_bb;
-		ev->passed_pawn_bb[WHITE] = entry.passed_pawn_white_bb;
-		ev->passed_pawn_bb[BLACK] = entry.passed_pawn_black_bb;
 	} else {
-		u64 bb, pawn_bb;
-		u64* atks_bb;
-		int c, sq;
-		int eval[2] = { 0, 0 };
+		u64 bb, pawn_bb, enemy_pawn_bb, stop_sq_bb;
+		u64 atk_span_bb[2] = { 0ULL, 0ULL };
+		int c, sq, file;
 		for (c = WHITE; c <= BLACK; ++c) {
-			atks_bb = ev->atks_bb[c];
-			pawn_bb = ev->pawn_bb[c];
-			bb      = pawn_bb;
+			entry.score[c]          = 0;
+			entry.passed_pawn_bb[c] = 0ULL;
+			entry.pawn_atks_bb[c]   = 0ULL;
+			pawn_bb                 = ev->pawn_bb[c];
+			enemy_pawn_bb           = ev->pawn_bb[!c];
+			bb                      = pawn_bb;
 			while (bb) {
 				sq  = bitscan(bb);
 				bb &= bb - 1;
 
-				// Store the attacks
-				atks_bb[PAWN] |= p_atks_bb[c][sq];
+				// Store the attacks and the squares the pawn can attack as it advances
+				entry.pawn_atks_bb[c] |= p_atks_bb[c][sq];
+				atk_span_bb[c]        |= adjacent_forward_mask[c][sq];
 
 				// Pawn of the same color in front of this pawn => Doubled pawn
-				if (file_forward_mask[c][sq] & pawn_bb)
-					eval[c] += doubled_pawns;
+				if (file_forward_mask[c][sq] & pawn_bb) {
+					entry.score[c] += ep->doubled_pawns;
+					trace_add(ev, DOUBLED_PAWNS, c, 1);
+				}
 
 				// No pawn of same color in adjacent files and not doubled => Isolated pawn
-				if (!(adjacent_files_mask[file_of(sq)] & pawn_bb))
-					eval[c] += isolated_pawn;
+				if (!(adjacent_files_mask[file_of(sq)] & pawn_bb)) {
+					entry.score[c] += ep->isolated_pawn;
+					trace_add(ev, ISOLATED_PAWN, c, 1);
+				} else {
+					// No pawn of same color level with or behind on adjacent files and
+					// the square in front attacked by an enemy pawn => Backward pawn
+					stop_sq_bb = pawn_shift(BB(sq), c);
+					if (    stop_sq_bb
+					    && !(adjacent_forward_mask[!c][bitscan(stop_sq_bb)] & pawn_bb)
+					    &&  (p_atks_bb[c][bitscan(stop_sq_bb)] & enemy_pawn_bb)) {
+						entry.score[c] += ep->backward_pawn;
+						trace_add(ev, BACKWARD_PAWN, c, 1);
+					}
+				}
+
+				// Pawn of the same color beside or defending this pawn => Connected pawn
+				if ((adjacent_sqs_mask[sq] | p_atks_bb[!c][sq]) & pawn_bb) {
+					entry.score[c] += ep->connected_pawn;
+					trace_add(ev, CONNECTED_PAWN, c, 1);
+				}
 
 				// Store passed pawn position for later
 				if (is_passed_pawn(pos, sq, c))
-					ev->passed_pawn_bb[c] |= BB(sq);
+					entry.passed_pawn_bb[c] |= BB(sq);
 			}
+
+			// Shelter and storm for each file the king can stand on its back rank
+			for (file = FILE_A; file <= FILE_H; ++file)
+				entry.king_shelter[c][file] = king_shelter(ep, pawn_bb, enemy_pawn_bb,
+									   get_sq(rank_lookup[c][RANK_1], file), c);
 		}
 
-		pt_store(&pt, eval[WHITE], eval[BLACK], ev->passed_pawn_bb[WHITE], ev->passed_pawn_bb[BLACK],
-			 ev->atks_bb[WHITE][PAWN], ev->atks_bb[BLACK][PAWN], pos->state->pawn_key);
+		// Squares which can never be attacked by an enemy pawn => Outposts
+		entry.outpost_bb[WHITE] = outpost_ranks_mask[WHITE] & ~atk_span_bb[BLACK];
+		entry.outpost_bb[BLACK] = outpost_ranks_mask[BLACK] & ~atk_span_bb[WHITE];
 
-		ev->eval[WHITE] += eval[WHITE];
-		ev->eval[BLACK] += eval[BLACK];
+		if (ev->pt)
+			pt_store(ev->pt, &entry, pos->state->pawn_key);
 	}
+
+	for (int c = WHITE; c <= BLACK; ++c) {
+		ev->eval[c]          += entry.score[c];
+		ev->atks_bb[c][PAWN]  = entry.pawn_atks_bb[c];
+		ev->passed_pawn_bb[c] = entry.passed_pawn_bb[c];
+		ev->outpost_bb[c]     = entry.outpost_bb[c];
+	}
+
+	eval_king_shelter(pos, ev, &entry);
 }
 
 static void eval_pieces(struct Position* const pos, struct Eval* const ev)
@@ -234,6 +324,7 @@ static void eval_pieces(struct Position* const pos, struct Eval* const ev)
 	u64* atks_bb;
 	u64* bb      = pos->bb;
 	u64  full_bb = bb[FULL];
+	struct EvalParams const * const ep = ev->ep;
 
 	int* eval = ev->eval;
 	for (c = WHITE; c <= BLACK; ++c) {
@@ -247,8 +338,10 @@ static void eval_pieces(struct Position* const pos, struct Eval* const ev)
 			curr_bb = bb[pt] & bb[c];
 
 			// If there are 2 bishops of the same color => Dual bishops
-			if (pt == BISHOP && popcnt(curr_bb) >= 2)
-				eval[c] += bishop_pair;
+			if (pt == BISHOP && popcnt(curr_bb) >= 2) {
+				eval[c] += ep->bishop_pair;
+				trace_add(ev, BISHOP_PAIR, c, 1);
+			}
 
 			curr_bb &= non_pinned_bb;
 			while (curr_bb) {
@@ -265,18 +358,20 @@ static void eval_pieces(struct Position* const pos, struct Eval* const ev)
 
 				// Calculate mobility count by counting attacked squares which are not attacked by
 				// an enemy pawn and does not have our king on it
-				mobility_val = mobility[pt] * (popcnt(atk_bb & mobility_mask) - min_mob_count[pt]);
+				mobility_val = ep->mobility[pt] * (popcnt(atk_bb & mobility_mask) - min_mob_count[pt]);
 				eval[c]     += S(mobility_val, mobility_val);
+				trace_add(ev, KNIGHT_MOB_WT + pt - KNIGHT, c, popcnt(atk_bb & mobility_mask) - min_mob_count[pt]);
 
 				// Update king attack statistics
 				if (atk_bb & ev->king_danger_zone_bb[!c])
-					ev->king_atk_pressure[c] += popcnt(atk_bb & ev->king_danger_zone_bb[!c]) * king_atk_wt[pt];
+					ev->king_atk_pressure[c] += popcnt(atk_bb & ev->king_danger_zone_bb[!c]) * ep->king_atk_wt[pt];
 
-				// Knight or bishop on relative 4th, 5th or 6th rank and not attacked by an enemy pawn
+				// Knight or bishop on relative 4th, 5th or 6th rank which no enemy pawn can attack
 				if (   (pt == KNIGHT || pt == BISHOP)
-				    && (~ev->atks_bb[!c][PAWN] & sq_bb)
-				    && (sq_bb & outpost_ranks_mask[c]))
-					eval[c] += outpost[pt & 1];
+				    && (sq_bb & ev->outpost_bb[c])) {
+					eval[c] += ep->outpost[pt & 1];
+					trace_add(ev, pt == KNIGHT ? KNIGHT_OUTPOST : BISHOP_OUTPOST, c, 1);
+				}
 
 				// No same colored pawn in front of the rook
 				else if (     pt == ROOK
@@ -284,13 +379,16 @@ static void eval_pieces(struct Position* const pos, struct Eval* const ev)
 					// Opposite colored pawn in front of the rook => Rook on semi-open file
 					// Otherwise => Rook on open file
 					eval[c] += (file_forward_mask[c][sq] & ev->pawn_bb[!c])
-						  ? rook_semi_open
-						  : rook_open_file;
+						  ? ep->rook_semi_open
+						  : ep->rook_open_file;
+					trace_add(ev, (file_forward_mask[c][sq] & ev->pawn_bb[!c]) ? ROOK_SEMI_OPEN : ROOK_OPEN, c, 1);
 
 					// If rook on relative 7th rank and king on relative 8th rank, bonus
 					if (   rank_of(sq) == rank_lookup[c][RANK_7]
-					    && rank_of(king_sq(pos, !c)) == rank_lookup[c][RANK_8])
-						eval[c] += rook_on_7th;
+					    && rank_of(king_sq(pos, !c)) == rank_lookup[c][RANK_8]) {
+						eval[c] += ep->rook_on_7th;
+						trace_add(ev, ROOK_ON_7TH, c, 1);
+					}
 				}
 			}
 		}
@@ -311,19 +409,11 @@ static void eval_pieces(struct Position* const pos, struct Eval* const ev)
 
 			// Update king attack statistics
 			if (atk_bb & ev->king_danger_zone_bb[!c])
-				ev->king_atk_pressure[c] += popcnt(atk_bb & ev->king_danger_zone_bb[!c]) * king_atk_wt[pt];
+				ev->king_atk_pressure[c] += popcnt(atk_bb & ev->king_danger_zone_bb[!c]) * ep->king_atk_wt[pt];
 		}
 	}
 }
 
-static void eval_king_shelter(struct Position* const pos, struct Eval* const ev)
-{
-	ev->eval[WHITE] += popcnt(ev->pawn_bb[WHITE] & king_shelter_close_mask[WHITE][pos->king_sq[WHITE]]) * king_shelter_close
-		         + popcnt(ev->pawn_bb[WHITE] & king_shelter_far_mask[WHITE][pos->king_sq[WHITE]]) * king_shelter_far;
-	ev->eval[BLACK] += popcnt(ev->pawn_bb[BLACK] & king_shelter_close_mask[BLACK][pos->king_sq[BLACK]]) * king_shelter_close
-		         + popcnt(ev->pawn_bb[BLACK] & king_shelter_far_mask[BLACK][pos->king_sq[BLACK]]) * king_shelter_far;
-}
-
 static void eval_king_attacks(struct Position* const pos, struct Eval* const ev)
 {
 	int king_atks[2] = { 0, 0 };
@@ -384,36 +474,52 @@ int can_win(u64 const * const bb, int c)
 		|| ((bb[BISHOP] & bb[c]) && (bb[KNIGHT] & bb[c]));
 }
 
-int evaluate(struct Position* const pos)
+static inline int eval_internal(struct Position* const pos, struct PT* const pawn_table,
+				struct EvalTrace* const trace)
 {
-	if (insufficient_material(pos))
+	if (insufficient_material(pos)) {
+		if (trace)
+			trace->scale = 0;
 		return 0;
+	}
 
 	struct Eval ev;
-	int ksq, c, pt;
+	int ksq, c, pt, count;
+	ev.ep    = pos->eval_params;
+	ev.pt    = pawn_table;
+	ev.trace = trace;
 	for (c = WHITE; c <= BLACK; ++c) {
 		ksq = king_sq(pos, c);
 		ev.pawn_bb[c] = pos->bb[PAWN] & pos->bb[c];
-		ev.passed_pawn_bb[c] = 0ULL;
 		ev.king_atk_pressure[c] = 0;
 		ev.king_danger_zone_bb[c] = (k_atks_bb[ksq] | pawn_shift(k_atks_bb[ksq], c) | BB(ksq));
+		ev.eval[c] = pos->piece_psq_eval[c];
 		for (pt = 0; pt != KING; ++pt)
 			ev.atks_bb[c][pt] = 0ULL;
+		// Material is counted here so one position can be evaluated with any set of params
+		for (pt = PAWN; pt != KING; ++pt) {
+			count       = popcnt(pos->bb[pt] & pos->bb[c]);
+			ev.eval[c] += count * ev.ep->piece_val[pt];
+			trace_add(&ev, PAWN_VAL + pt - PAWN, c, count);
+		}
 	}
 
 	ev.pinned_bb[WHITE] = get_pinned(pos, WHITE);
 	ev.pinned_bb[BLACK] = get_pinned(pos, BLACK);
 
-	ev.eval[WHITE] = pos->piece_psq_eval[WHITE];
-	ev.eval[BLACK] = pos->piece_psq_eval[BLACK];
-
 	eval_pawns(pos, &ev);
 	eval_pieces(pos, &ev);
 	eval_king_attacks(pos, &ev);
-	eval_king_shelter(pos, &ev);
 	eval_passed_pawns(pos, &ev);
 
 	int eval = phased_val((ev.eval[WHITE] - ev.eval[BLACK]), pos->phase);
+	if (trace) {
+		trace->eval[0] = mg_val(ev.eval[WHITE] - ev.eval[BLACK]);
+		trace->eval[1] = eg_val(ev.eval[WHITE] - ev.eval[BLACK]);
+		trace->phase   = pos->phase;
+		trace->scale   = 1;
+		trace->clamp   = 0;
+	}
 
 	// Eval reductions
 	int piece_count = popcnt(pos->bb[FULL]);
@@ -421,21 +527,45 @@ int evaluate(struct Position* const pos)
 	if (    piece_count == 5
 	    && (pos->bb[KNIGHT] | pos->bb[BISHOP])
 	    && (pos->bb[WHITE] & pos->bb[ROOK])
-	    && (pos->bb[BLACK] & pos->bb[ROOK]))
+	    && (pos->bb[BLACK] & pos->bb[ROOK])) {
 		eval /= 16;
+		if (trace)
+			trace->scale = 16;
+	}
 
 	if (    piece_count == 4
 	    && (pos->bb[ROOK] && (pos->bb[KNIGHT] | pos->bb[BISHOP]))
-	    &&  popcnt(pos->bb[WHITE] == 2))
+	    &&  popcnt(pos->bb[WHITE] == 2)) {
 		eval /= 16;
+		if (trace)
+			trace->scale = 16;
+	}
 
 	if (    popcnt(pos->bb[WHITE]) <= 3
-	    && !can_win(pos->bb, WHITE))
+	    && !can_win(pos->bb, WHITE)) {
 		eval = min(eval, 0);
+		if (trace)
+			trace->clamp |= CLAMP_WHITE;
+	}
 
 	if (    popcnt(pos->bb[BLACK]) <= 3
-	    && !can_win(pos->bb, BLACK))
+	    && !can_win(pos->bb, BLACK)) {
 		eval = max(eval, 0);
+		if (trace)
+			trace->clamp |= CLAMP_BLACK;
+	}
 
 	return pos->stm == WHITE ? eval : -eval;
 }
+
+// The pawn table may be NULL
+int evaluate_pt(struct Position* const pos, struct PT* const pawn_table)
+{
+	return eval_internal(pos, pawn_table, NULL);
+}
+
+int evaluate_trace(struct Position* const pos, struct EvalTrace* const trace)
+{
+	memset(trace, 0, sizeof(struct EvalTrace));
+	return eval_internal(pos, NULL, trace);
+}
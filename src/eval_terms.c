@@ -20,33 +20,37 @@
 
 struct EvalTerm eval_terms[NUM_TERMS] = {
 	// Tapered terms
-	{ "PawnValue",        &piece_val[PAWN]     },
-	{ "KnightValue",      &piece_val[KNIGHT]   },
-	{ "BishopValue",      &piece_val[BISHOP]   },
-	{ "RookValue",        &piece_val[ROOK]     },
-	{ "QueenValue",       &piece_val[QUEEN]    },
-	{ "KingShelterClose", &king_shelter_close  },
-	{ "KingShelterFar",   &king_shelter_far    },
-	{ "DoubledPawns",     &doubled_pawns       },
-	{ "IsolatedPawn",     &isolated_pawn       },
-	{ "BishopPair",       &bishop_pair         },
-	{ "RookOn7th",        &rook_on_7th         },
-	{ "RookOpenFile",     &rook_open_file      },
-	{ "RookSemiOpenFile", &rook_semi_open      },
-	{ "KnightOutpost",    &outpost[1]          },
-	{ "BishopOutpost",    &outpost[0]          },
+	{ "PawnValue",        offsetof(struct EvalParams, piece_val[PAWN]) },
+	{ "KnightValue",      offsetof(struct EvalParams, piece_val[KNIGHT]) },
+	{ "BishopValue",      offsetof(struct EvalParams, piece_val[BISHOP]) },
+	{ "RookValue",        offsetof(struct EvalParams, piece_val[ROOK]) },
+	{ "QueenValue",       offsetof(struct EvalParams, piece_val[QUEEN]) },
+	{ "KingShelterClose", offsetof(struct EvalParams, king_shelter_close) },
+	{ "KingShelterFar",   offsetof(struct EvalParams, king_shelter_far) },
+	{ "PawnStormClose",   offsetof(struct EvalParams, pawn_storm_close) },
+	{ "PawnStormFar",     offsetof(struct EvalParams, pawn_storm_far) },
+	{ "DoubledPawns",     offsetof(struct EvalParams, doubled_pawns) },
+	{ "IsolatedPawn",     offsetof(struct EvalParams, isolated_pawn) },
+	{ "BackwardPawn",     offsetof(struct EvalParams, backward_pawn) },
+	{ "ConnectedPawn",    offsetof(struct EvalParams, connected_pawn) },
+	{ "BishopPair",       offsetof(struct EvalParams, bishop_pair) },
+	{ "RookOn7th",        offsetof(struct EvalParams, rook_on_7th) },
+	{ "RookOpenFile",     offsetof(struct EvalParams, rook_open_file) },
+	{ "RookSemiOpenFile", offsetof(struct EvalParams, rook_semi_open) },
+	{ "KnightOutpost",    offsetof(struct EvalParams, outpost[1]) },
+	{ "BishopOutpost",    offsetof(struct EvalParams, outpost[0]) },
 	// Non-tapered terms
-	{ "KnightKingAtkWt",  &king_atk_wt[KNIGHT] },
-	{ "BishopKingAtkWt",  &king_atk_wt[BISHOP] },
-	{ "RookKingAtkWt",    &king_atk_wt[ROOK]   },
-	{ "QueenKingAtkWt",   &king_atk_wt[QUEEN]  },
-	{ "KnightMobilityWt", &mobility[KNIGHT]    },
-	{ "BishopMobilityWt", &mobility[BISHOP]    },
-	{ "RookMobilityWt",   &mobility[ROOK]      },
-	{ "QueenMobilityWt",  &mobility[QUEEN]     },
+	{ "KnightKingAtkWt",  offsetof(struct EvalParams, king_atk_wt[KNIGHT]) },
+	{ "BishopKingAtkWt",  offsetof(struct EvalParams, king_atk_wt[BISHOP]) },
+	{ "RookKingAtkWt",    offsetof(struct EvalParams, king_atk_wt[ROOK]) },
+	{ "QueenKingAtkWt",   offsetof(struct EvalParams, king_atk_wt[QUEEN]) },
+	{ "KnightMobilityWt", offsetof(struct EvalParams, mobility[KNIGHT]) },
+	{ "BishopMobilityWt", offsetof(struct EvalParams, mobility[BISHOP]) },
+	{ "RookMobilityWt",   offsetof(struct EvalParams, mobility[ROOK]) },
+	{ "QueenMobilityWt",  offsetof(struct EvalParams, mobility[QUEEN]) },
 };
 
-int parse_persona_file(char const * const path)
+int parse_persona_file(struct EvalParams* const ep, char const * const path)
 {
 	FILE* file = fopen(path, "r");
 	if (!file)
@@ -57,8 +61,9 @@ int parse_persona_file(char const * const path)
 		if (!fgets(buf, max_len, file))
 			break;
 		buf[strlen(buf) - 1] = '\0';
-		parse_eval_term(buf, "=");
+		parse_eval_term(ep, buf, "=");
 	}
+	fclose(file);
 
 	return 0;
 }
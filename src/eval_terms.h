@@ -19,17 +19,39 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stddef.h>
 #include "defs.h"
 
-extern int piece_val[8], king_atk_wt[7], king_shelter_close, king_shelter_far,
-           doubled_pawns, isolated_pawn, mobility[7], bishop_pair,
-	   rook_on_7th, rook_open_file, rook_semi_open, outpost[2];
+// Terms which can be set through a persona, each engine instance evaluates with its own copy
+struct EvalParams
+{
+	int piece_val[8];
+	int king_atk_wt[7];
+	int king_shelter_close;
+	int king_shelter_far;
+	int pawn_storm_close;
+	int pawn_storm_far;
+	int doubled_pawns;
+	int isolated_pawn;
+	int backward_pawn;
+	int connected_pawn;
+	int mobility[7];
+	int bishop_pair;
+	int rook_on_7th;
+	int rook_open_file;
+	int rook_semi_open;
+	int outpost[2];
+};
+
+extern struct EvalParams eval_params;
 
 enum EvalTermList
 {
 	PAWN_VAL, KNIGHT_VAL, BISHOP_VAL, ROOK_VAL, QUEEN_VAL,
 	KING_SHELTER_CLOSE, KING_SHELTER_FAR,
+	PAWN_STORM_CLOSE, PAWN_STORM_FAR,
 	DOUBLED_PAWNS, ISOLATED_PAWN,
+	BACKWARD_PAWN, CONNECTED_PAWN,
 	BISHOP_PAIR, ROOK_ON_7TH, ROOK_OPEN, ROOK_SEMI_OPEN,
 	KNIGHT_OUTPOST, BISHOP_OUTPOST,
 	TAPERED_END,
@@ -38,27 +60,52 @@ enum EvalTermList
 	NUM_TERMS
 };
 
+enum TraceClamp
+{
+	CLAMP_WHITE = 1, // White cannot win, eval is at most 0
+	CLAMP_BLACK = 2  // Black cannot win, eval is at least 0
+};
+
+// Bump whenever the evaluation changes apart from the EvalParams values, tuning traces built by an
+// older evaluation are then rebuilt
+#define EVAL_VERSION (1)
+
+// Linear form of an evaluation: eval = coeffs . terms + the remaining untraced eval
+struct EvalTrace
+{
+	int coeffs[NUM_TERMS][2]; // White minus black count of each term, Mg and Eg
+	int eval[2];              // Full Mg and Eg eval from white's side before phasing
+	int phase;
+	int scale;                // Divisor applied by the eval reductions, 0 for a dead draw
+	int clamp;
+};
+
 struct EvalTerm
 {
 	char name[50];
-	int* ptr;
+	size_t offset; // Offset of the term in struct EvalParams
 };
 
 extern struct EvalTerm eval_terms[NUM_TERMS];
 
-static inline int* get_eval_term(char* term)
+static inline int* eval_term_ptr(struct EvalParams* const ep, struct EvalTerm const * const term)
+{
+	return (int*) ((char*) ep + term->offset);
+}
+
+static inline int* get_eval_term(struct EvalParams* const ep, char* term)
 {
 	struct EvalTerm* curr_et = eval_terms;
 	struct EvalTerm* end_et  = eval_terms + NUM_TERMS;
 	for (; curr_et != end_et; ++curr_et) {
 		int len = strlen(curr_et->name);
 		if (!strncmp(term, curr_et->name, len))
-			return curr_et->ptr;
+			return eval_term_ptr(ep, curr_et);
 	}
 	return NULL;
 }
 
-static inline void parse_eval_term(char* term, char* separator)
+static inline void parse_eval_term(struct EvalParams* const ep, char* term, char* separator)
 {
 	char* end;
 	int sep_len = strlen(separator);
@@ -74,14 +121,14 @@ static inline void parse_eval_term(char* term, char* separator)
 					if (!strncmp(term, separator, sep_len)) {
 						int value = strtoul(term + sep_len + 1, &end, 10);
 						if (value <= 10000 && value >= -10000)
-							set_mg_val(*curr_et->ptr, value);
+							set_mg_val(*eval_term_ptr(ep, curr_et), value);
 					}
 				} else if (!strncmp(term, "Eg", 2)) {
 					term += 3;
 					if (!strncmp(term, separator, sep_len)) {
 						int value = strtoul(term + sep_len + 1, &end, 10);
 						if (value <= 10000 && value >= -10000)
-							set_eg_val(*curr_et->ptr, value);
+							set_eg_val(*eval_term_ptr(ep, curr_et), value);
 					}
 				}
 			} else {
@@ -89,13 +136,13 @@ static inline void parse_eval_term(char* term, char* separator)
 				if (!strncmp(term, separator, sep_len)) {
 					int value = strtoul(term + sep_len + 1, &end, 10);
 					if (value <= 10000 && value >= -10000)
-						*curr_et->ptr = value;
+						*eval_term_ptr(ep, curr_et) = value;
 				}
 			}
 		}
 	}
 }
 
-extern int parse_persona_file(char const * const path);
+extern int parse_persona_file(struct EvalParams* const ep, char const * const path);
 
 #endif
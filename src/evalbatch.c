@@ -0,0 +1,178 @@
+/*
+ * WyldChess, a free UCI/Xboard compatible chess engine
+ * Copyright (C) 2016-2017 Manik Charan
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include <pthread.h>
+#include "position.h"
+#include "pt.h"
+#include "packpos.h"
+
+#define BATCH_PT_MB   (2)
+#define BATCH_INVALID (INT_MIN)  // Score of a line that is not a valid FEN
+
+struct BatchWorker
+{
+	char** lines;
+	struct PackedPos const* packed;
+	u32 begin;
+	u32 end;
+	int* scores;
+};
+
+static void* batch_worker(void* arg)
+{
+	struct BatchWorker* worker = (struct BatchWorker*) arg;
+	struct Position* pos = malloc(sizeof(struct Position));
+	struct PT local_pt = { NULL, 0 };
+	char fen[MAX_FEN_LEN];
+	pt_alloc_MB(&local_pt, BATCH_PT_MB);
+	for (u32 i = worker->begin; i != worker->end; ++i) {
+		if (worker->packed) {
+			unpack_pos(pos, worker->packed + i);
+		} else {
+			// Long EPD operations past the FEN fields are cut, they do not change the evaluation
+			char const* line = worker->lines[i];
+			if (strlen(line) >= MAX_FEN_LEN) {
+				memcpy(fen, line, MAX_FEN_LEN - 1);
+				fen[MAX_FEN_LEN - 1] = '\0';
+				line = fen;
+			}
+			init_pos(pos);
+			if (set_pos_checked(pos, line)) {
+				worker->scores[i] = BATCH_INVALID;
+				continue;
+			}
+		}
+		worker->scores[i] = evaluate_pt(pos, &local_pt);
+	}
+	pt_destroy(&local_pt);
+	free(pos);
+	return NULL;
+}
+
+// Read the whole file and split it into lines, blank lines and comments are dropped
+static char* read_lines(char const * const path, char*** lines, u32* num_lines)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return NULL;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	// Padding keeps set_pos within the buffer on a last line without move counters
+	char* buf = calloc(size + 4, 1);
+	size = fread(buf, 1, size, file);
+	fclose(file);
+
+	u32 capacity = 1 << 16;
+	*lines       = malloc(sizeof(char*) * capacity);
+	*num_lines   = 0;
+	char* ptr    = buf;
+	char* end;
+	while (*ptr) {
+		end = strchr(ptr, '\n');
+		if (end) {
+			*end = '\0';
+			if (end > ptr && end[-1] == '\r')
+				end[-1] = '\0';
+		}
+		if (*ptr && *ptr != '\r' && *ptr != '#') {
+			if (*num_lines == capacity) {
+				capacity *= 2;
+				*lines    = realloc(*lines, sizeof(char*) * capacity);
+			}
+			(*lines)[(*num_lines)++] = ptr;
+		}
+		if (!end)
+			break;
+		ptr = end + 1;
+	}
+	return buf;
+}
+
+// Files ending in .bin hold packed positions, anything else is read as FEN/EPD lines
+void eval_batch(char const * const in_path, char const * const out_path, int num_threads)
+{
+	u64 start = curr_time();
+	struct PackedReader reader = { NULL, 0, 0 };
+	char** lines = NULL;
+	char* buf    = NULL;
+	u32 num_lines, i;
+	size_t len = strlen(in_path);
+	int packed = len > 4 && !strcmp(in_path + len - 4, ".bin");
+	if (packed ? packed_reader_open(&reader, in_path)
+		   : !(buf = read_lines(in_path, &lines, &num_lines))) {
+		fprintf(stdout, "info string Unable to open %s\n", in_path);
+		return;
+	}
+	if (packed)
+		num_lines = reader.count;
+	FILE* out = out_path ? fopen(out_path, "w") : stdout;
+	if (!out) {
+		fprintf(stdout, "info string Unable to open %s\n", out_path);
+		packed_reader_close(&reader);
+		free(lines);
+		free(buf);
+		return;
+	}
+
+	u64 read_time = curr_time();
+	int* scores = malloc(sizeof(int) * max(num_lines, 1));
+	int num_workers = max(min(num_threads, num_lines), 1);
+	struct BatchWorker workers[MAX_THREADS];
+	pthread_t threads[MAX_THREADS];
+	u32 per_worker = num_lines / num_workers;
+	for (i = 0; i != num_workers; ++i) {
+		workers[i].lines  = lines;
+		workers[i].packed = reader.data;
+		workers[i].begin  = i * per_worker;
+		workers[i].end    = i == num_workers - 1 ? num_lines : workers[i].begin + per_worker;
+		workers[i].scores = scores;
+		pthread_create(threads + i, NULL, batch_worker, workers + i);
+	}
+	for (i = 0; i != num_workers; ++i)
+		pthread_join(threads[i], NULL);
+	u64 eval_time = curr_time() - read_time;
+
+	// Scores are from the side to move's point of view, one per position in input order. They are
+	// formatted into one buffer and written at once, stdout is unbuffered. Lines that are not a valid
+	// FEN are reported and get no score.
+	char* text = malloc((size_t) num_lines * 12 + 1);
+	char* end  = text;
+	u32 invalid = 0;
+	for (i = 0; i != num_lines; ++i) {
+		if (scores[i] == BATCH_INVALID) {
+			fprintf(stdout, "info string Skipped invalid fen: %s\n", lines[i]);
+			++invalid;
+			continue;
+		}
+		end += sprintf(end, "%d\n", scores[i]);
+	}
+	fwrite(text, 1, end - text, out);
+	free(text);
+	if (out != stdout)
+		fclose(out);
+
+	u64 total_time = curr_time() - start;
+	fprintf(stdout, "info string Evaluated %u positions in %llu ms (%llu ms total), %llu pos/s, %u invalid\n",
+		num_lines - invalid, eval_time, total_time, num_lines * 1000ULL / max(total_time, 1), invalid);
+	packed_reader_close(&reader);
+	free(scores);
+	free(lines);
+	free(buf);
+}
@@ -295,59 +295,59 @@ static void gen_pawn_quiets(struct Position* pos, struct Movelist* list)
 	}
 }
 
-static void gen_castling(struct Position* pos, struct Movelist* list)
+static int const castling_poss[2][2] = {
+	{ WKC, WQC },
+	{ BKC, BQC }
+};
+static int const king_end_pos[2][2] = {
+	{ G1, C1 },
+	{ G8, C8 }
+};
+static int const rook_end_pos[2][2] = {
+	{ F1, D1 },
+	{ F8, D8 }
+};
+
+// Castling is allowed by the rights and the board, the side to move must not be in check
+static int can_castle(struct Position* const pos, int cside)
 {
-	static int const castling_poss[2][2] = {
-		{ WKC, WQC },
-		{ BKC, BQC }
-	};
-	static int const king_end_pos[2][2] = {
-		{ G1, C1 },
-		{ G8, C8 }
-	};
-	static int const rook_end_pos[2][2] = {
-		{ F1, D1 },
-		{ F8, D8 }
-	};
-
-	int c = pos->stm;
-	int ksq = pos->king_sq[c];
-	int sq, rsq, k_end_sq, r_end_sq, can_castle;
-	u64 full_bb, intermediate_sqs_bb;
-	for (int cside = KINGSIDE; cside <= QUEENSIDE; ++cside) {
-		// Make sure we can castle on the chosen side
-		if (castling_poss[c][cside] & pos->state->castling_rights) {
-			rsq = castling_rook_pos[c][cside];
-			k_end_sq = king_end_pos[c][cside];
-			r_end_sq = rook_end_pos[c][cside];
-			full_bb = pos->bb[FULL] ^ BB(ksq) ^ BB(rsq);
-
-			// Check for vacant intermediate squares for rook
-			intermediate_sqs_bb = intervening_sqs_bb[rsq][r_end_sq] | BB(r_end_sq);
-			if (intermediate_sqs_bb & full_bb)
-				continue;
-
-			// Check for vacant intermediate squares for king
-			intermediate_sqs_bb = intervening_sqs_bb[ksq][k_end_sq] | BB(k_end_sq);
-			if (intermediate_sqs_bb & full_bb)
-				continue;
-
-			// Check if any intermediate squares of king are attacked
-			can_castle = 1;
-			while (intermediate_sqs_bb) {
-				sq = bitscan(intermediate_sqs_bb);
-				intermediate_sqs_bb &= intermediate_sqs_bb - 1;
-				if (atkers_to_sq(pos, sq, !c, full_bb)) {
-					can_castle = 0;
-					break;
-				}
-			}
-
-			// If all fine, add castling move
-			if (can_castle)
-				add_move(move_castle(ksq, k_end_sq), list);
-		}
+	int const c = pos->stm;
+
+	// Make sure we can castle on the chosen side
+	if (!(castling_poss[c][cside] & pos->state->castling_rights))
+		return 0;
+
+	int const ksq      = pos->king_sq[c],
+	          rsq      = pos->castling_rook_pos[c][cside],
+	          k_end_sq = king_end_pos[c][cside],
+	          r_end_sq = rook_end_pos[c][cside];
+	u64 const full_bb  = pos->bb[FULL] ^ BB(ksq) ^ BB(rsq);
+
+	// Check for vacant intermediate squares for rook
+	u64 intermediate_sqs_bb = intervening_sqs_bb[rsq][r_end_sq] | BB(r_end_sq);
+	if (intermediate_sqs_bb & full_bb)
+		return 0;
+
+	// Check for vacant intermediate squares for king
+	intermediate_sqs_bb = intervening_sqs_bb[ksq][k_end_sq] | BB(k_end_sq);
+	if (intermediate_sqs_bb & full_bb)
+		return 0;
+
+	// Check if any intermediate squares of king are attacked
+	while (intermediate_sqs_bb) {
+		if (atkers_to_sq(pos, bitscan(intermediate_sqs_bb), !c, full_bb))
+			return 0;
+		intermediate_sqs_bb &= intermediate_sqs_bb - 1;
 	}
+	return 1;
+}
+
+static void gen_castling(struct Position* pos, struct Movelist* list)
+{
+	int const c = pos->stm;
+	for (int cside = KINGSIDE; cside <= QUEENSIDE; ++cside)
+		if (can_castle(pos, cside))
+			add_move(move_castle(pos->king_sq[c], king_end_pos[c][cside]), list);
 }
 
 void gen_quiesce_moves(struct Position* pos, struct Movelist* list)
@@ -404,3 +404,98 @@ void gen_legal_moves(struct Position* pos, struct Movelist* list)
 			++move;
 	}
 }
+
+// Decodes a move in coordinate notation from the board alone. Returns 0 unless it is one
+// of the moves gen_pseudo_legal_moves would generate, so legal_move completes the check.
+u32 parse_move(struct Position* const pos, char const * const str)
+{
+	if (   str[0] < 'a' || str[0] > 'h'
+	    || str[1] < '1' || str[1] > '8'
+	    || str[2] < 'a' || str[2] > 'h'
+	    || str[3] < '1' || str[3] > '8')
+		return 0;
+
+	int const c    = pos->stm,
+	          from = (str[0] - 'a') + ((str[1] - '1') << 3),
+	          to   = (str[2] - 'a') + ((str[3] - '1') << 3),
+	          pt   = pos->board[from],
+	          ksq  = king_sq(pos, c);
+	if (!(BB(from) & pos->bb[c]))
+		return 0;
+
+	set_pinned(pos);
+	set_checkers(pos);
+	u64 const checkers_bb = pos->state->checkers_bb,
+	          full_bb     = pos->bb[FULL];
+	int cside;
+
+	// In FRC castling is given as the king capturing its own rook
+	if (   pos->is_frc
+	    && pt == KING
+	    && (BB(to) & pos->bb[c])
+	    && pos->board[to] == ROOK) {
+		cside = pos->castling_rook_pos[c][KINGSIDE] == to ? KINGSIDE : QUEENSIDE;
+		return    !checkers_bb
+		       &&  pos->castling_rook_pos[c][cside] == to
+		       &&  can_castle(pos, cside)
+		       ? move_castle(from, king_end_pos[c][cside]) : 0;
+	}
+	if (BB(to) & pos->bb[c])
+		return 0;
+	if (   !pos->is_frc
+	    &&  pt == KING
+	    &&  rank_of(from) == rank_of(to)
+	    &&  abs(to - from) == 2) {
+		cside = to > from ? KINGSIDE : QUEENSIDE;
+		return    !checkers_bb
+		       &&  king_end_pos[c][cside] == to
+		       &&  can_castle(pos, cside)
+		       ? move_castle(from, to) : 0;
+	}
+
+	u32 move;
+	int const cap_pt = pos->board[to];
+	if (pt == PAWN) {
+		int const forward = c == WHITE ? 8 : -8;
+		int prom = 0;
+		if (is_prom_sq[to]) {
+			switch (str[4]) {
+			case 'q': prom = TO_QUEEN;  break;
+			case 'n': prom = TO_KNIGHT; break;
+			case 'r': prom = TO_ROOK;   break;
+			case 'b': prom = TO_BISHOP; break;
+			default:  return 0;
+			}
+		}
+		if (BB(to) & pos->state->ep_sq_bb & p_atks_bb[c][from])
+			move = move_ep(from, to);
+		else if (BB(to) & pos->bb[!c] & p_atks_bb[c][from])
+			move = prom ? move_prom_cap(from, to, prom, cap_pt) : move_cap(from, to, cap_pt);
+		else if (   to == from + forward
+			 && !cap_pt)
+			move = prom ? move_prom(from, to, prom) : move_normal(from, to);
+		else if (   to == from + 2 * forward
+			 && rank_of(from) == (c == WHITE ? RANK_2 : RANK_7)
+			 && !((BB(from + forward) | BB(to)) & full_bb))
+			move = move_double_push(from, to);
+		else
+			return 0;
+	} else {
+		if (!(BB(to) & (pt == KING ? k_atks_bb[from] : get_atks(from, pt, full_bb))))
+			return 0;
+		move = move_cap(from, to, cap_pt);
+	}
+
+	// In check only the evasions gen_check_evasions generates are accepted
+	if (checkers_bb) {
+		if (pt == KING)
+			return atkers_to_sq(pos, to, !c, full_bb ^ BB(from)) ? 0 : move;
+		if (checkers_bb & (checkers_bb - 1))
+			return 0;
+		if (move_type(move) == ENPASSANT)
+			return pawn_shift(pos->state->ep_sq_bb, !c) & checkers_bb ? move : 0;
+		if (!(BB(to) & (checkers_bb | intervening_sqs_bb[bitscan(checkers_bb)][ksq])))
+			return 0;
+	}
+	return move;
+}
@@ -0,0 +1,216 @@
+/*
+ * WyldChess, a free UCI/Xboard compatible chess engine
+ * Copyright (C) 2016-2017 Manik Charan
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "search.h"
+#include "packpos.h"
+#include "pt.h"
+
+#define GENSFEN_TT_MB    (16)
+#define GENSFEN_PT_MB    (1)
+#define WRITE_BUF_LEN    (1 << 14)
+#define MAX_GAME_PLIES   (400)
+#define REPORT_INTERVAL  (100)
+
+struct GensfenWorker
+{
+	int id;
+	u64 seed;
+	u64 games;
+	u64 positions;
+	u64 time;
+	struct Position const* start_pos;
+};
+
+static struct GensfenParams const* gp;
+static pthread_mutex_t buf_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct TrainingEntry* write_buf;
+static u32 write_buf_len;
+static u64 positions_written;
+static u32 games_started;
+static FILE* out_file;
+
+static int next_game()
+{
+	pthread_mutex_lock(&buf_mutex);
+	int ok = games_started < gp->games;
+	games_started += ok;
+	pthread_mutex_unlock(&buf_mutex);
+	return ok;
+}
+
+// The buffer is bounded, whichever thread fills it writes it out
+static void push_entries(struct TrainingEntry const * const entries, u32 num)
+{
+	pthread_mutex_lock(&buf_mutex);
+	for (u32 i = 0; i != num; ++i) {
+		write_buf[write_buf_len++] = entries[i];
+		if (write_buf_len == WRITE_BUF_LEN) {
+			fwrite(write_buf, sizeof(struct TrainingEntry), write_buf_len, out_file);
+			write_buf_len = 0;
+		}
+	}
+	positions_written += num;
+	pthread_mutex_unlock(&buf_mutex);
+}
+
+// Play one game and return the number of recorded positions, -1 when the opening ran into a dead end
+static int play_game(struct SearchUnit* const su, struct SearchStack* const ss, struct Position const * const start_pos,
+		     struct TrainingEntry* const game, u64* const seed)
+{
+	struct Position* const pos = &su->pos;
+	struct Movelist list;
+	u32 i, move;
+	int num = 0, result, white_result = 1, score = 0;
+
+	get_position_copy(start_pos, pos);
+	tt_clear(su->ctlr->tt);
+	init_search(&su->sl);
+
+	for (i = 0; i != gp->random_plies; ++i) {
+		set_checkers(pos);
+		set_pinned(pos);
+		list.end = list.moves;
+		gen_legal_moves(pos, &list);
+		if (list.end == list.moves)
+			return -1;
+		do_move(pos, list.moves[xorshift_rand(seed) % (list.end - list.moves)]);
+	}
+
+	for (i = 0; i != MAX_GAME_PLIES; ++i) {
+		if ((result = game_result(pos)) != NO_RESULT) {
+			white_result = result == DRAW ? 1 : pos->stm == WHITE ? 0 : 2;
+			break;
+		}
+		if (!(move = search_silent(su, ss, &score)))
+			return -1;
+
+		// Record quiet positions only, the score of a tactical one says little about the eval
+		if (   !pos->state->checkers_bb
+		    && !cap_type(move)
+		    &&  move_type(move) != ENPASSANT
+		    &&  move_type(move) != PROMOTION
+		    &&  abs(score) < gp->eval_limit) {
+			pack_pos(pos, &game[num].pos);
+			game[num].move  = move;
+			game[num].score = score;
+			game[num].pad   = 0;
+			++num;
+		}
+
+		if (abs(score) >= gp->eval_limit) {
+			white_result = (score > 0) == (pos->stm == WHITE) ? 2 : 0;
+			break;
+		}
+		do_move(pos, move);
+	}
+
+	for (i = 0; i != num; ++i)
+		game[i].result = white_result;
+	return num;
+}
+
+static void* gensfen_worker(void* arg)
+{
+	struct GensfenWorker* const worker = (struct GensfenWorker*) arg;
+	struct Controller* ctlr     = calloc(1, sizeof(struct Controller));
+	struct SearchUnit* su       = calloc(1, sizeof(struct SearchUnit));
+	struct SearchStack* ss      = malloc(sizeof(struct SearchStack) * MAX_PLY);
+	struct TrainingEntry* game  = malloc(sizeof(struct TrainingEntry) * MAX_GAME_PLIES);
+	struct TT local_tt          = { NULL, 0 };
+	struct PT local_pt          = { NULL, 0 };
+	tt_alloc_MB(&local_tt, GENSFEN_TT_MB);
+	pt_alloc_MB(&local_pt, GENSFEN_PT_MB);
+	ctlr->depth       = gp->depth;
+	ctlr->node_limit  = gp->nodes;
+	ctlr->tt          = &local_tt;
+	ctlr->pt          = &local_pt;
+	su->ctlr          = ctlr;
+	su->id            = 0;
+	su->type          = MAIN;
+	su->protocol      = NO_PROTOCOL;
+	su->target_state  = THINKING;
+	alloc_search_locals(&su->sl);
+
+	u64 start = curr_time();
+	int num;
+	while (next_game()) {
+		while ((num = play_game(su, ss, worker->start_pos, game, &worker->seed)) == -1)
+			continue;
+		push_entries(game, num);
+		++worker->games;
+		worker->positions += num;
+		if (!(worker->games % REPORT_INTERVAL)) {
+			u64 time = max(curr_time() - start, 1);
+			fprintf(stdout, "info string thread %d games %llu positions %llu pos/s %llu\n",
+				worker->id, worker->games, worker->positions, worker->positions * 1000 / time);
+		}
+	}
+	worker->time = curr_time() - start;
+
+	pt_destroy(&local_pt);
+	tt_destroy(&local_tt);
+	destroy_search_locals(&su->sl);
+	free(game);
+	free(ss);
+	free(su);
+	free(ctlr);
+	return NULL;
+}
+
+void gensfen(char const * const out_path, struct GensfenParams const * const params)
+{
+	if (!(out_file = fopen(out_path, "wb"))) {
+		fprintf(stdout, "info string Unable to open %s\n", out_path);
+		return;
+	}
+	gp                = params;
+	write_buf         = malloc(sizeof(struct TrainingEntry) * WRITE_BUF_LEN);
+	write_buf_len     = 0;
+	positions_written = 0;
+	games_started     = 0;
+
+	// The start position is set up once and copied into every game
+	struct Position* start_pos = malloc(sizeof(struct Position));
+	init_pos(start_pos);
+	set_pos(start_pos, INITIAL_POSITION);
+
+	u64 start = curr_time();
+	int num_threads = params->threads;
+	struct GensfenWorker workers[MAX_THREADS];
+	pthread_t threads[MAX_THREADS];
+	int i;
+	for (i = 0; i != num_threads; ++i) {
+		workers[i] = (struct GensfenWorker) { i, params->seed + (i + 1) * 0x9E3779B97F4A7C15ULL, 0, 0, 0, start_pos };
+		pthread_create(threads + i, NULL, gensfen_worker, workers + i);
+	}
+	for (i = 0; i != num_threads; ++i)
+		pthread_join(threads[i], NULL);
+
+	fwrite(write_buf, sizeof(struct TrainingEntry), write_buf_len, out_file);
+	fclose(out_file);
+	free(write_buf);
+	free(start_pos);
+
+	for (i = 0; i != num_threads; ++i)
+		fprintf(stdout, "info string thread %d games %llu positions %llu pos/s %llu\n",
+			i, workers[i].games, workers[i].positions,
+			workers[i].positions * 1000 / max(workers[i].time, 1));
+	u64 time = max(curr_time() - start, 1);
+	fprintf(stdout, "info string Wrote %llu positions from %u games to %s in %llu ms, %llu pos/s\n",
+		positions_written, params->games, out_path, time, positions_written * 1000 / time);
+}
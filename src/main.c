@@ -16,48 +16,37 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <time.h>
-#include "eval_terms.h"
-#include "search_unit.h"
-#include "magicmoves.h"
-#include "position.h"
-#include "search.h"
-#include "misc.h"
-#include "tt.h"
-#include "pt.h"
-
-struct TT tt;
-struct PT pt;
-struct Controller controller;
+#include "engine.h"
+#include "packpos.h"
 
 int main()
 {
 	setbuf(stdout, NULL);
 	setbuf(stdin, NULL);
-	init_timer();
-	init_genrand64(234702970592742ULL);
-	init_zobrist_keys();
-	initmagicmoves();
-	init_lookups();
-	init_eval_terms();
-	tt_alloc_MB(&tt, 128);
-	pt_alloc_MB(&pt, 8);
-
-	struct SpinOption* curr = spin_options;
-	struct SpinOption* end  = spin_options + NUM_OPTIONS;
-	for (; curr != end; ++curr) {
-		if (curr->handler)
-			curr->handler();
+	struct Engine* engine = wc_create(128);
+	if (!engine) {
+		fprintf(stdout, "Out of memory\n");
+		return 1;
 	}
 
 	char input[100];
+	int status = 0;
 	while (1) {
 		fgets(input, 100, stdin);
 		if (!strncmp(input, "xboard", 6)) {
-			xboard_loop();
+			xboard_loop(engine);
 			break;
 		} else if (!strncmp(input, "uci", 3)) {
-			uci_loop();
+			uci_loop(engine);
+			break;
+		} else if (!strncmp(input, "bench", 5)) {
+			bench(engine, strtoul(input + 5, NULL, 10));
+			break;
+		} else if (!strncmp(input, "seebench", 8)) {
+			see_bench();
+			break;
+		} else if (!strncmp(input, "packcheck", 9)) {
+			status = pack_check() ? 1 : 0;
 			break;
 		} else if (!strncmp(input, "quit", 4)) {
 			break;
@@ -66,8 +55,7 @@ int main()
 		}
 	}
 
-	pt_destroy(&pt);
-	tt_destroy(&tt);
+	wc_destroy(engine);
 
-	return 0;
+	return status;
 }
@@ -0,0 +1,363 @@
+/*
+ * WyldChess, a free UCI/Xboard compatible chess engine
+ * Copyright (C) 2016-2017 Manik Charan
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include "search.h"
+#include "eval_terms.h"
+#include "pt.h"
+#include "syzygy/tbprobe.h"
+
+#define MATCH_TT_MB       (8)
+#define MATCH_PT_MB       (1)
+#define MAX_GAME_PLIES    (400)
+#define REPORT_INTERVAL   (50)
+#define WIN_ADJ_PLIES     (4)   // Consecutive plies both engines must see a decided score
+#define DRAW_ADJ_START    (80)
+#define DRAW_ADJ_PLIES    (8)
+#define DRAW_ADJ_SCORE    (10)
+#define SPRT_ALPHA        (0.05)
+#define SPRT_BETA         (0.05)
+
+enum MatchEngines {
+	ENGINE_A,
+	ENGINE_B
+};
+
+struct MatchEngine
+{
+	struct Controller* ctlr;
+	struct SearchUnit* su;
+	struct TT tt;
+	struct PT pt;
+};
+
+struct MatchStats
+{
+	u32 wins;    // From engine A's point of view
+	u32 draws;
+	u32 losses;
+	u32 adjudicated;
+	u32 tb_adjudicated;
+	u32 errors;  // Games stopped by a search without a move, left out of the score
+};
+
+static struct MatchParams const* mp;
+static struct EvalParams const* engine_params[2];
+static struct Position const* start_pos;
+static pthread_mutex_t match_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct MatchStats stats;
+static u32 games_started;
+static u64 match_start;
+static volatile int sprt_done;
+
+static inline double elo_to_score(double elo)
+{
+	return 1.0 / (1.0 + pow(10.0, -elo / 400.0));
+}
+
+static inline double score_to_elo(double score)
+{
+	return -400.0 * log10(1.0 / score - 1.0);
+}
+
+// Normal approximation of the trinomial GSPRT, as used by fishtest before pentanomial stats
+static double sprt_llr(struct MatchStats const * const st, double elo0, double elo1)
+{
+	double n = st->wins + st->draws + st->losses;
+	if (!n)
+		return 0.0;
+	double w   = st->wins / n;
+	double d   = st->draws / n;
+	double l   = st->losses / n;
+	double s   = w + d / 2;
+	double var = w * (1 - s) * (1 - s) + d * (0.5 - s) * (0.5 - s) + l * s * s;
+	double s0  = elo_to_score(elo0);
+	double s1  = elo_to_score(elo1);
+	if (var <= 0.0)
+		return 0.0;
+	return n * (s1 - s0) * (2 * s - s0 - s1) / (2 * var);
+}
+
+// Called with match_mutex held
+static void print_match_stats()
+{
+	u32 n = stats.wins + stats.draws + stats.losses;
+	if (!n)
+		return;
+	double s   = (stats.wins + stats.draws / 2.0) / n;
+	double w   = (double) stats.wins / n;
+	double d   = (double) stats.draws / n;
+	double l   = (double) stats.losses / n;
+	double var = w * (1 - s) * (1 - s) + d * (0.5 - s) * (0.5 - s) + l * s * s;
+	double dev = 1.96 * sqrt(var / n);
+	double lo  = s - dev > 0.0 ? s - dev : 1e-6;
+	double hi  = s + dev < 1.0 ? s + dev : 1 - 1e-6;
+	double elo = s > 0.0 && s < 1.0 ? score_to_elo(s) : s > 0.0 ? 9999 : -9999;
+	u64 time   = max(curr_time() - match_start, 1);
+	fprintf(stdout, "info string Games %u W %u D %u L %u adjudicated %u (tb %u) errors %u elo %.1f +/- %.1f games/s %.2f\n",
+		n, stats.wins, stats.draws, stats.losses, stats.adjudicated, stats.tb_adjudicated, stats.errors,
+		elo, (score_to_elo(hi) - score_to_elo(lo)) / 2, n * 1000.0 / time);
+	if (mp->sprt)
+		fprintf(stdout, "info string SPRT elo0 %d elo1 %d llr %.2f bounds [%.2f, %.2f]\n",
+			mp->elo0, mp->elo1, sprt_llr(&stats, mp->elo0, mp->elo1),
+			log(SPRT_BETA / (1 - SPRT_ALPHA)), log((1 - SPRT_BETA) / SPRT_ALPHA));
+	fflush(stdout);
+}
+
+static int next_game()
+{
+	pthread_mutex_lock(&match_mutex);
+	int game = games_started < mp->games && !sprt_done ? (int) games_started++ : -1;
+	pthread_mutex_unlock(&match_mutex);
+	return game;
+}
+
+// Result is 0, 1 or 2 half-points for engine A
+static void record_result(int result, int adjudicated, int tb_adjudicated)
+{
+	pthread_mutex_lock(&match_mutex);
+	stats.losses         += result == 0;
+	stats.draws          += result == 1;
+	stats.wins           += result == 2;
+	stats.adjudicated    += adjudicated;
+	stats.tb_adjudicated += tb_adjudicated;
+	u32 n = stats.wins + stats.draws + stats.losses;
+	if (mp->sprt && !sprt_done) {
+		double llr = sprt_llr(&stats, mp->elo0, mp->elo1);
+		if (   llr <= log(SPRT_BETA / (1 - SPRT_ALPHA))
+		    || llr >= log((1 - SPRT_BETA) / SPRT_ALPHA)) {
+			sprt_done = 1;
+			fprintf(stdout, "info string SPRT %s after %u games\n",
+				llr > 0 ? "accepted H1" : "accepted H0", n);
+		}
+	}
+	if (!(n % REPORT_INTERVAL))
+		print_match_stats();
+	pthread_mutex_unlock(&match_mutex);
+}
+
+// The game is left out of the score and of the SPRT
+static void record_error(int game)
+{
+	pthread_mutex_lock(&match_mutex);
+	++stats.errors;
+	fprintf(stdout, "info string Game %d stopped, the search returned no move\n", game + 1);
+	pthread_mutex_unlock(&match_mutex);
+}
+
+// Both games of a pair start from the same random opening with colors swapped
+static int gen_opening(struct Position* const pos, u32 pair, u32* const moves)
+{
+	struct Movelist list;
+	u64 seed = mp->seed ^ ((pair + 1) * 0x9E3779B97F4A7C15ULL);
+	u32 i;
+	while (1) {
+		get_position_copy(start_pos, pos);
+		for (i = 0; i != mp->random_plies; ++i) {
+			set_checkers(pos);
+			set_pinned(pos);
+			list.end = list.moves;
+			gen_legal_moves(pos, &list);
+			if (list.end == list.moves)
+				break;
+			moves[i] = list.moves[xorshift_rand(&seed) % (list.end - list.moves)];
+			do_move(pos, moves[i]);
+		}
+		if (   i == mp->random_plies
+		    && game_result(pos) == NO_RESULT)
+			return i;
+	}
+}
+
+static void play_game(struct MatchEngine* const engines, struct SearchStack* const ss, int game, u32* const moves)
+{
+	struct Position* pos;
+	u32 i, j, move, num_moves;
+	int e, c, result = NO_RESULT, score = 0, white_score;
+	unsigned int wdl;
+	int white_result = 1, adjudicated = 0, tb_adjudicated = 0;
+	int win_plies = 0, draw_plies = 0, last_sign = 0;
+	// Engine A plays white in even games
+	int white_engine = game & 1;
+
+	num_moves = gen_opening(&engines[ENGINE_A].su->pos, game / 2, moves);
+	for (e = ENGINE_A; e <= ENGINE_B; ++e) {
+		pos = &engines[e].su->pos;
+		get_position_copy(start_pos, pos);
+		pos->eval_params = engine_params[e];
+		for (j = 0; j != num_moves; ++j)
+			do_move(pos, moves[j]);
+		tt_clear(&engines[e].tt);
+		init_search(&engines[e].su->sl);
+	}
+
+	for (i = 0; i != MAX_GAME_PLIES; ++i) {
+		pos = &engines[ENGINE_A].su->pos;
+		if ((result = game_result(pos)) != NO_RESULT) {
+			white_result = result == DRAW ? 1 : pos->stm == WHITE ? 0 : 2;
+			break;
+		}
+
+		// Same conditions the search probes under
+		if (    TB_LARGEST > 0
+		    && !pos->state->castling_rights
+		    && !pos->state->fifty_moves
+		    &&  popcnt(pos->bb[FULL]) <= TB_LARGEST) {
+			u64* bb = pos->bb;
+			wdl = tb_probe_wdl(bb[WHITE], bb[BLACK], bb[KING], bb[QUEEN], bb[ROOK],
+					   bb[BISHOP], bb[KNIGHT], bb[PAWN],
+					   pos->state->ep_sq_bb ? bitscan(pos->state->ep_sq_bb) : 0,
+					   pos->stm == WHITE);
+			if (wdl != TB_RESULT_FAILED) {
+				white_result   = wdl == TB_WIN  ? (pos->stm == WHITE ? 2 : 0)
+					       : wdl == TB_LOSS ? (pos->stm == WHITE ? 0 : 2)
+					       : 1;
+				tb_adjudicated = 1;
+				break;
+			}
+		}
+
+		c = pos->stm;
+		e = c == WHITE ? white_engine : !white_engine;
+		struct Controller* const ctlr = engines[e].ctlr;
+		if (mp->movetime) {
+			ctlr->search_start_time = curr_time();
+			ctlr->search_end_time   = ctlr->search_start_time + mp->movetime;
+		}
+		// game_result found legal moves, so a search without a move failed
+		if (!(move = search_silent(engines[e].su, ss, &score))) {
+			record_error(game);
+			return;
+		}
+
+		// Eval adjudication needs the score to hold across several moves of both engines
+		white_score = c == WHITE ? score : -score;
+		if (abs(white_score) >= mp->eval_limit) {
+			win_plies = (white_score > 0) == last_sign ? win_plies + 1 : 1;
+			last_sign = white_score > 0;
+		} else {
+			win_plies = 0;
+		}
+		draw_plies = abs(white_score) <= DRAW_ADJ_SCORE ? draw_plies + 1 : 0;
+		if (win_plies >= WIN_ADJ_PLIES) {
+			white_result = white_score > 0 ? 2 : 0;
+			adjudicated  = 1;
+			break;
+		}
+		if (   i >= DRAW_ADJ_START
+		    && draw_plies >= DRAW_ADJ_PLIES) {
+			adjudicated = 1;
+			break;
+		}
+
+		do_move(&engines[ENGINE_A].su->pos, move);
+		do_move(&engines[ENGINE_B].su->pos, move);
+	}
+
+	record_result(white_engine == ENGINE_A ? white_result : 2 - white_result, adjudicated, tb_adjudicated);
+}
+
+static void* match_worker(void* arg)
+{
+	(void) arg;
+	struct MatchEngine engines[2];
+	struct SearchStack* ss = malloc(sizeof(struct SearchStack) * MAX_PLY);
+	u32* moves             = malloc(sizeof(u32) * (mp->random_plies + 1));
+	int e, game;
+	for (e = ENGINE_A; e <= ENGINE_B; ++e) {
+		struct MatchEngine* const engine = engines + e;
+		engine->ctlr = calloc(1, sizeof(struct Controller));
+		engine->su   = calloc(1, sizeof(struct SearchUnit));
+		engine->tt   = (struct TT) { NULL, 0 };
+		engine->pt   = (struct PT) { NULL, 0 };
+		// Pawn entries hold scores of one parameter set, so the tables are never shared
+		tt_alloc_MB(&engine->tt, MATCH_TT_MB);
+		pt_alloc_MB(&engine->pt, MATCH_PT_MB);
+		engine->ctlr->depth          = mp->depth;
+		engine->ctlr->node_limit     = mp->nodes;
+		engine->ctlr->time_dependent = mp->movetime > 0;
+		engine->ctlr->tt             = &engine->tt;
+		engine->ctlr->pt             = &engine->pt;
+		engine->su->ctlr             = engine->ctlr;
+		engine->su->id               = 0;
+		engine->su->type             = MAIN;
+		engine->su->protocol         = NO_PROTOCOL;
+		engine->su->target_state     = THINKING;
+		alloc_search_locals(&engine->su->sl);
+	}
+
+	while ((game = next_game()) != -1)
+		play_game(engines, ss, game, moves);
+
+	for (e = ENGINE_A; e <= ENGINE_B; ++e) {
+		pt_destroy(&engines[e].pt);
+		tt_destroy(&engines[e].tt);
+		destroy_search_locals(&engines[e].su->sl);
+		free(engines[e].su);
+		free(engines[e].ctlr);
+	}
+	free(moves);
+	free(ss);
+	return NULL;
+}
+
+// A persona of "-" plays with the current evaluation parameters
+static int load_engine_params(struct EvalParams* const ep, char const * const path)
+{
+	*ep = eval_params;
+	if (!strcmp(path, "-"))
+		return 0;
+	if (parse_persona_file(ep, path)) {
+		fprintf(stdout, "info string Unable to open %s\n", path);
+		return 1;
+	}
+	return 0;
+}
+
+void match(char const * const persona_a, char const * const persona_b, struct MatchParams const * const params)
+{
+	struct EvalParams ep[2];
+	if (   load_engine_params(ep + ENGINE_A, persona_a)
+	    || load_engine_params(ep + ENGINE_B, persona_b))
+		return;
+	engine_params[ENGINE_A] = ep + ENGINE_A;
+	engine_params[ENGINE_B] = ep + ENGINE_B;
+	mp            = params;
+	stats         = (struct MatchStats) { 0, 0, 0, 0, 0, 0 };
+	games_started = 0;
+	sprt_done     = 0;
+
+	// The start position is set up once and copied into every game
+	struct Position* pos = malloc(sizeof(struct Position));
+	init_pos(pos);
+	set_pos(pos, INITIAL_POSITION);
+	start_pos = pos;
+
+	match_start = curr_time();
+	int num_threads = params->threads;
+	pthread_t threads[MAX_THREADS];
+	int i;
+	for (i = 0; i != num_threads; ++i)
+		pthread_create(threads + i, NULL, match_worker, NULL);
+	for (i = 0; i != num_threads; ++i)
+		pthread_join(threads[i], NULL);
+
+	fprintf(stdout, "info string Match %s vs %s finished\n", persona_a, persona_b);
+	print_match_stats();
+	free(pos);
+}
@@ -0,0 +1,262 @@
+/*
+ * WyldChess, a free UCI/Xboard compatible chess engine
+ * Copyright (C) 2016-2017 Manik Charan
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include "defs.h"
+#include "position.h"
+#include "misc.h"
+
+// Depth first proof number search(df-pn, Nagai 2002) for a mate in a given number of moves.
+// Proof and disproof numbers are kept for the side to move of each node as phi and delta,
+// phi == 0 is a win for it and delta == 0 a loss. The attacker wins by mating, the defender
+// by surviving the last attacker move.
+
+#define PN_INF           (100000000U)
+#define PN_BUCKET        (2)
+#define PN_NON_CHECK     (2)  // Initial proof number of a quiet attacker move, checks get 1
+#define MAX_MATE_MOVES   ((MAX_PLY - 1) / 2)
+
+struct PNEntry
+{
+	u64 key;
+	u32 phi;
+	u32 delta;
+	u64 work;  // Nodes searched below the entry, the cheaper one of a bucket is replaced
+};
+
+struct PNTable
+{
+	struct PNEntry* table;
+	u64 size;  // In buckets
+};
+
+static struct PNTable pn_table;
+static u64 pn_nodes;
+static u64 pn_max_nodes;
+static int pn_aborted;
+
+// The plies left are part of the key, so a result is only reused for the same mate length
+static inline u64 pn_key(struct Position const * const pos, int plies_left)
+{
+	return pos->state->pos_key ^ (plies_left * 0x9E3779B97F4A7C15ULL);
+}
+
+static int pn_probe(u64 key, u32* const phi, u32* const delta, u64* const work)
+{
+	struct PNEntry* entry = pn_table.table + (key % pn_table.size) * PN_BUCKET;
+	for (int i = 0; i != PN_BUCKET; ++i, ++entry) {
+		if (entry->key == key) {
+			*phi   = entry->phi;
+			*delta = entry->delta;
+			*work  = entry->work;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void pn_store(u64 key, u32 phi, u32 delta, u64 work)
+{
+	struct PNEntry* bucket = pn_table.table + (key % pn_table.size) * PN_BUCKET;
+	struct PNEntry* replace = bucket;
+	for (int i = 0; i != PN_BUCKET; ++i) {
+		if (bucket[i].key == key) {
+			replace = bucket + i;
+			break;
+		}
+		if (bucket[i].work < replace->work)
+			replace = bucket + i;
+	}
+	*replace = (struct PNEntry) { key, phi, delta, work };
+}
+
+static inline void gen_moves(struct Position* const pos, struct Movelist* const list)
+{
+	list->end = list->moves;
+	set_checkers(pos);
+	set_pinned(pos);
+	gen_legal_moves(pos, list);
+}
+
+static void mid(struct Position* const pos, int plies_left, u32 th_phi, u32 th_delta, u32* const phi, u32* const delta)
+{
+	++pn_nodes;
+	u64 const start_nodes = pn_nodes;
+	u64 const key = pn_key(pos, plies_left);
+	int const attacker = plies_left & 1;
+
+	struct Movelist list;
+	gen_moves(pos, &list);
+	int num = list.end - list.moves;
+
+	// Mated or stalemated, or the defender survived the last attacker move
+	if (   !num
+	    || (!attacker && !plies_left)) {
+		int win = !attacker && (num || !pos->state->checkers_bb);
+		*phi    = win ? 0 : PN_INF;
+		*delta  = win ? PN_INF : 0;
+		pn_store(key, *phi, *delta, 1);
+		return;
+	}
+
+	u64 child_keys[MAX_MOVES_PER_POS];
+	u32 child_phi[MAX_MOVES_PER_POS];
+	u32 child_delta[MAX_MOVES_PER_POS];
+	u64 work;
+	int i;
+	for (i = 0; i != num; ++i) {
+		u32 move = list.moves[i];
+		int check = attacker && gives_check(pos, move);
+		do_move(pos, move);
+		child_keys[i] = pn_key(pos, plies_left - 1);
+		undo_move(pos);
+		if (!pn_probe(child_keys[i], child_phi + i, child_delta + i, &work)) {
+			child_phi[i]   = 1;
+			child_delta[i] = attacker && !check ? PN_NON_CHECK : 1;
+		}
+	}
+
+	while (1) {
+		u32 min_delta = PN_INF, second_delta = PN_INF, sum_phi = 0;
+		int best = 0;
+		for (i = 0; i != num; ++i) {
+			if (child_delta[i] < min_delta) {
+				second_delta = min_delta;
+				min_delta    = child_delta[i];
+				best         = i;
+			} else if (child_delta[i] < second_delta) {
+				second_delta = child_delta[i];
+			}
+			sum_phi = min(PN_INF, sum_phi + child_phi[i]);
+		}
+		*phi   = min_delta;
+		*delta = sum_phi;
+		if (   *phi >= th_phi
+		    || *delta >= th_delta
+		    || pn_aborted)
+			break;
+		if (pn_max_nodes && pn_nodes >= pn_max_nodes) {
+			pn_aborted = 1;
+			break;
+		}
+
+		// Search the most proving child until it is no longer the best one
+		u32 c_th_phi   = th_delta - sum_phi + child_phi[best];
+		u32 c_th_delta = min(th_phi, second_delta + 1);
+		do_move(pos, list.moves[best]);
+		mid(pos, plies_left - 1, c_th_phi, c_th_delta, child_phi + best, child_delta + best);
+		undo_move(pos);
+	}
+
+	pn_store(key, *phi, *delta, pn_nodes - start_nodes);
+}
+
+// Plies until mate with best play, searched with growing length on the warm table, max_plies + 1 when beyond
+static int mate_plies(struct Position* const pos, int attacker, int max_plies)
+{
+	u32 phi, delta;
+	for (int plies = attacker ? 1 : 0; plies <= max_plies; plies += 2) {
+		mid(pos, plies, PN_INF, PN_INF, &phi, &delta);
+		if (attacker ? !phi : !delta)
+			return plies;
+	}
+	return max_plies + 1;
+}
+
+// The attacker takes the quickest proven mate, the defender the reply that delays it the longest
+static int mate_pv(struct Position* const pos, int plies_left, u32* const pv)
+{
+	struct Movelist list;
+	u32 phi, delta, best_move;
+	u64 work;
+	int len = 0, plies, best_plies;
+	while (plies_left > 0) {
+		int const attacker = plies_left & 1;
+		gen_moves(pos, &list);
+		best_move  = 0;
+		best_plies = attacker ? plies_left : -1;
+		for (u32* move = list.moves; move < list.end; ++move) {
+			do_move(pos, *move);
+			if (   !attacker
+			    || (   pn_probe(pn_key(pos, plies_left - 1), &phi, &delta, &work)
+				&& !delta)) {
+				plies = mate_plies(pos, !attacker, plies_left - 1);
+				if (attacker ? plies < best_plies : plies > best_plies) {
+					best_move  = *move;
+					best_plies = plies;
+				}
+			}
+			undo_move(pos);
+		}
+		if (   !best_move
+		    ||  best_plies >= plies_left)
+			break;
+		do_move(pos, best_move);
+		pv[len++]  = best_move;
+		plies_left = best_plies;
+	}
+	for (int i = 0; i != len; ++i)
+		undo_move(pos);
+	return len;
+}
+
+void mate_search(struct Position* const pos, u32 max_moves, u64 max_nodes, u32 mb)
+{
+	max_moves           = max(1, min(max_moves, MAX_MATE_MOVES));
+	mb                  = mb < 1 ? 1 : mb > 1048576 ? 1048576 : mb;
+	pn_table.size       = (u64) mb * 0x100000 / (sizeof(struct PNEntry) * PN_BUCKET);
+	pn_table.table      = calloc(pn_table.size * PN_BUCKET, sizeof(struct PNEntry));
+	if (!pn_table.table) {
+		fprintf(stdout, "info string Unable to allocate %u MB for the mate search\n", mb);
+		return;
+	}
+	pn_nodes            = 0;
+	pn_max_nodes        = max_nodes;
+	pn_aborted          = 0;
+
+	u64 start = curr_time();
+	u32 phi = PN_INF, delta = 0, moves, pv[MAX_PLY];
+	char mstr[6];
+	for (moves = 1; moves <= max_moves; ++moves) {
+		mid(pos, 2 * moves - 1, PN_INF, PN_INF, &phi, &delta);
+		u64 time = curr_time() - start;
+		fprintf(stdout, "info depth %u nodes %llu time %llu nps %llu", moves, pn_nodes, time, pn_nodes * 1000 / max(time, 1));
+		if (!phi) {
+			fprintf(stdout, " score mate %u pv", moves);
+			pn_max_nodes = 0;
+			int len = mate_pv(pos, 2 * moves - 1, pv);
+			for (int i = 0; i != len; ++i) {
+				move_str(pos, pv[i], mstr);
+				fprintf(stdout, " %s", mstr);
+			}
+		}
+		fprintf(stdout, "\n");
+		if (!phi || pn_aborted)
+			break;
+	}
+
+	if (!phi)
+		fprintf(stdout, "info string Mate in %u found\n", moves);
+	else if (pn_aborted)
+		fprintf(stdout, "info string Node limit reached, no mate in %u moves or less\n", moves - 1);
+	else
+		fprintf(stdout, "info string No mate in %u moves or less\n", max_moves);
+
+	free(pn_table.table);
+	pn_table.table = NULL;
+}
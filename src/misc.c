@@ -16,6 +16,8 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdarg.h>
+#include <unistd.h>
 #include "misc.h"
 
 u64 psq_keys[2][8][64];
@@ -31,11 +33,73 @@ void init_timer()
 
 unsigned long long curr_time()
 {
-	static struct timeval curr;
+	struct timeval curr;
 	gettimeofday(&curr, 0);
 	return ((curr.tv_sec - start_time.tv_sec) * 1000 + ((curr.tv_usec - start_time.tv_usec) / 1000.0));
 }
 
+// Reads a whole line without its line break, the buffer is grown as needed. Returns 0 at the end of the input.
+int read_line(char** const buf, u32* const cap, FILE* const file)
+{
+	if (!*buf) {
+		*cap = 4096;
+		*buf = malloc(*cap);
+	}
+	u32 len = 0;
+	**buf = '\0';
+	while (fgets(*buf + len, *cap - len, file)) {
+		len += strlen(*buf + len);
+		if (len && (*buf)[len - 1] == '\n')
+			break;
+		if (len + 1 == *cap) {
+			*cap *= 2;
+			*buf  = realloc(*buf, *cap);
+		}
+	}
+	int ok = len != 0;
+	while (len && ((*buf)[len - 1] == '\n' || (*buf)[len - 1] == '\r'))
+		--len;
+	(*buf)[len] = '\0';
+	return ok;
+}
+
+struct OutBuf
+{
+	char buf[OUT_BUF_LEN];
+	int len;
+};
+
+static _Thread_local struct OutBuf out_buf;
+
+void out_flush()
+{
+	char const* ptr = out_buf.buf;
+	int left = out_buf.len;
+	ssize_t written;
+	while (   left > 0
+	       && (written = write(STDOUT_FILENO, ptr, left)) > 0) {
+		ptr  += written;
+		left -= written;
+	}
+	out_buf.len = 0;
+}
+
+// Text that does not fit any more flushes the buffer first, only a single line longer than the buffer is cut
+void out_printf(char const * const fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	int len = vsnprintf(out_buf.buf + out_buf.len, OUT_BUF_LEN - out_buf.len, fmt, args);
+	va_end(args);
+	if (out_buf.len + len >= OUT_BUF_LEN) {
+		out_flush();
+		va_start(args, fmt);
+		len = min(vsnprintf(out_buf.buf, OUT_BUF_LEN, fmt, args), OUT_BUF_LEN - 1);
+		va_end(args);
+	}
+	out_buf.len += max(len, 0);
+}
+
 u64 get_rand()
 {
 	u64 r;
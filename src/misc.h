@@ -35,5 +35,22 @@ extern u64 stm_key;
 
 extern void init_timer();
 extern unsigned long long curr_time();
+extern int read_line(char** const buf, u32* const cap, FILE* const file);
+
+// Search output is assembled in a buffer of the calling thread and written with a single call on
+// flushing, so a line is never split into several writes or interleaved with output of other threads
+#define OUT_BUF_LEN (16384)
+
+extern void out_printf(char const * const fmt, ...);
+extern void out_flush();
+
+// xorshift64*, for self-play workers which each keep their own state instead of sharing the engine's generator
+static inline u64 xorshift_rand(u64* const state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 2685821657736338717ULL;
+}
 
 #endif
@@ -82,19 +82,19 @@ void undo_move(struct Position* const pos)
 			switch (to) {
 			case C1:
 				rto = D1;
-				rfrom = castling_rook_pos[WHITE][QUEENSIDE];
+				rfrom = pos->castling_rook_pos[WHITE][QUEENSIDE];
 				break;
 			case G1:
 				rto = F1;
-				rfrom = castling_rook_pos[WHITE][KINGSIDE];
+				rfrom = pos->castling_rook_pos[WHITE][KINGSIDE];
 				break;
 			case C8:
 				rto = D8;
-				rfrom = castling_rook_pos[BLACK][QUEENSIDE];
+				rfrom = pos->castling_rook_pos[BLACK][QUEENSIDE];
 				break;
 			case G8:
 				rto = F8;
-				rfrom = castling_rook_pos[BLACK][KINGSIDE];
+				rfrom = pos->castling_rook_pos[BLACK][KINGSIDE];
 				break;
 			default:
 				rto = rfrom = -1;
@@ -182,19 +182,19 @@ void do_move(struct Position* const pos, u32 const m)
 			switch (to) {
 			case C1:
 				rto = D1;
-				rfrom = castling_rook_pos[WHITE][QUEENSIDE];
+				rfrom = pos->castling_rook_pos[WHITE][QUEENSIDE];
 				break;
 			case G1:
 				rto = F1;
-				rfrom = castling_rook_pos[WHITE][KINGSIDE];
+				rfrom = pos->castling_rook_pos[WHITE][KINGSIDE];
 				break;
 			case C8:
 				rto = D8;
-				rfrom = castling_rook_pos[BLACK][QUEENSIDE];
+				rfrom = pos->castling_rook_pos[BLACK][QUEENSIDE];
 				break;
 			case G8:
 				rto = F8;
-				rfrom = castling_rook_pos[BLACK][KINGSIDE];
+				rfrom = pos->castling_rook_pos[BLACK][KINGSIDE];
 				break;
 			default:
 				rto = rfrom = -1;
@@ -221,7 +221,7 @@ void do_move(struct Position* const pos, u32 const m)
 
 	pos->stm ^= 1;
 
-	next->castling_rights = (curr->castling_rights & castle_perms[from]) & castle_perms[to];
+	next->castling_rights = (curr->castling_rights & pos->castle_perms[from]) & pos->castle_perms[to];
 	next->pos_key        ^=  stm_key
 		               ^ castle_keys[curr->castling_rights]
 		               ^ castle_keys[next->castling_rights];
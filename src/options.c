@@ -18,14 +18,22 @@
 
 #include "defs.h"
 #include "options.h"
-#include "search_unit.h"
+#include "search_tune.h"
 
-pthread_t search_threads[MAX_THREADS];
-struct SearchUnit search_units[MAX_THREADS];
-struct SearchStack search_stacks[MAX_THREADS][MAX_PLY];
-struct SearchParams search_params[MAX_THREADS];
-
-struct SpinOption spin_options[NUM_OPTIONS] = {
-	{ "MoveOverhead", 30, 1, 5000, NULL },
-	{ "Threads", 1, 1, MAX_THREADS, NULL }
+struct SpinOption const spin_options[NUM_OPTIONS] = {
+	{ "MoveOverhead", 30, 1, 5000 },
+	{ "Threads", 1, 1, MAX_THREADS },
+	{ "MultiPV", 1, 1, MAX_MULTIPV }
 };
+
+#ifdef TUNE_BUILD
+
+#define X(var, name, val, lo, hi) int var = val;
+SEARCH_TUNABLES
+#undef X
+
+#define X(var, name, val, lo, hi) { name, &var, lo, hi, val },
+struct SearchTunable search_tunables[NUM_SEARCH_TUNABLES] = { SEARCH_TUNABLES };
+#undef X
+
+#endif
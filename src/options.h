@@ -22,19 +22,19 @@
 struct SpinOption
 {
 	char name[50];
-	int curr_val;
+	int default_val;  // The current values belong to each engine
 	int min_val;
 	int max_val;
-	void (*handler)(void);
 };
 
 enum OPTIONS
 {
 	MOVE_OVERHEAD,
 	THREADS,
+	MULTI_PV,
 	NUM_OPTIONS
 };
 
-extern struct SpinOption spin_options[NUM_OPTIONS];
+extern struct SpinOption const spin_options[NUM_OPTIONS];
 
 #endif
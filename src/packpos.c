@@ -0,0 +1,321 @@
+/*
+ * WyldChess, a free UCI/Xboard compatible chess engine
+ * Copyright (C) 2016-2017 Manik Charan
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "packpos.h"
+
+void pack_pos(struct Position const * const pos, struct PackedPos* const pp)
+{
+	u64 occ = pos->bb[FULL];
+	int i = 0, sq, cr;
+	memset(pp, 0, sizeof(struct PackedPos));
+	pp->occ = occ;
+	while (occ) {
+		sq   = bitscan(occ);
+		occ &= occ - 1;
+		pp->pieces[i >> 1] |= (pos->board[sq] | (!!(pos->bb[BLACK] & BB(sq)) << 3)) << ((i & 1) << 2);
+		++i;
+	}
+	pp->stm         = pos->stm;
+	pp->castling    = pos->state->castling_rights | (pos->is_frc ? PACKED_FRC : 0);
+	pp->ep_sq       = pos->state->ep_sq_bb ? bitscan(pos->state->ep_sq_bb) : PACKED_NO_EP;
+	pp->fifty_moves = pos->state->fifty_moves > 255 ? 255 : pos->state->fifty_moves;
+	pp->full_moves  = pos->state->full_moves > 65535 ? 65535 : pos->state->full_moves;
+	// Castling right i belongs to color i / 2 on side i % 2, see enum CastlingRights
+	for (cr = 0; cr != 4; ++cr)
+		if (pp->castling & (1 << cr))
+			pp->rook_files |= file_of(pos->castling_rook_pos[cr >> 1][cr & 1]) << (cr * 3);
+}
+
+void unpack_pos(struct Position* const pos, struct PackedPos const * const pp)
+{
+	u64 occ = pp->occ;
+	int i = 0, sq, piece, pt, c, cr, rank;
+	int castling = pp->castling & 15;
+	init_pos(pos);
+	pos->is_frc = !!(pp->castling & PACKED_FRC);
+	for (sq = 0; sq != 64; ++sq)
+		pos->castle_perms[sq] = 15;
+	while (occ) {
+		sq    = bitscan(occ);
+		occ  &= occ - 1;
+		piece = (pp->pieces[i >> 1] >> ((i & 1) << 2)) & 15;
+		pt    = piece & 7;
+		c     = piece >> 3;
+		put_piece(pos, sq, pt, c);
+		if (pt == KING) {
+			pos->king_sq[c]  = sq;
+			pos->castle_perms[sq] = c == WHITE ? 12 : 3;
+		}
+		++i;
+	}
+	pos->stm = pp->stm;
+	pos->state->castling_rights = castling;
+	for (cr = 0; cr != 4; ++cr) {
+		if (castling & (1 << cr)) {
+			rank = (cr >> 1) == WHITE ? RANK_1 : RANK_8;
+			sq   = get_sq(rank, ((pp->rook_files >> (cr * 3)) & 7));
+			pos->castling_rook_pos[cr >> 1][cr & 1] = sq;
+			pos->castle_perms[sq] = 15 ^ (1 << cr);
+		}
+	}
+	pos->state->pos_key ^= castle_keys[castling];
+	if (pp->ep_sq != PACKED_NO_EP) {
+		pos->state->pos_key ^= psq_keys[0][0][pp->ep_sq];
+		pos->state->ep_sq_bb = BB(pp->ep_sq);
+	}
+	pos->state->fifty_moves = pp->fifty_moves;
+	pos->state->full_moves  = pp->full_moves;
+}
+
+int packed_reader_open(struct PackedReader* const reader, char const * const path)
+{
+	reader->data  = NULL;
+	reader->count = 0;
+	reader->size  = 0;
+#ifdef _WIN32
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return 1;
+	fseek(file, 0, SEEK_END);
+	reader->size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	reader->count = reader->size / sizeof(struct PackedPos);
+	if (reader->count) {
+		struct PackedPos* data = malloc(reader->count * sizeof(struct PackedPos));
+		reader->count = fread(data, sizeof(struct PackedPos), reader->count, file);
+		reader->data  = data;
+	}
+	fclose(file);
+#else
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return 1;
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return 1;
+	}
+	reader->size  = st.st_size;
+	reader->count = reader->size / sizeof(struct PackedPos);
+	if (reader->count) {
+		void* map = mmap(NULL, reader->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			close(fd);
+			return 1;
+		}
+		posix_madvise(map, reader->size, POSIX_MADV_SEQUENTIAL);
+		reader->data = (struct PackedPos const*) map;
+	}
+	close(fd);
+#endif
+	return 0;
+}
+
+void packed_reader_close(struct PackedReader* const reader)
+{
+	if (!reader->data)
+		return;
+#ifdef _WIN32
+	free((void*) reader->data);
+#else
+	munmap((void*) reader->data, reader->size);
+#endif
+	reader->data = NULL;
+}
+
+int packed_writer_open(struct PackedWriter* const writer, char const * const path)
+{
+	writer->file = fopen(path, "wb");
+	if (!writer->file)
+		return 1;
+	writer->buf     = malloc(sizeof(struct PackedPos) * PACKED_WRITER_LEN);
+	writer->len     = 0;
+	writer->written = 0;
+	return 0;
+}
+
+static void packed_flush(struct PackedWriter* const writer)
+{
+	fwrite(writer->buf, sizeof(struct PackedPos), writer->len, writer->file);
+	writer->written += writer->len;
+	writer->len      = 0;
+}
+
+void packed_write(struct PackedWriter* const writer, struct PackedPos const * const pp)
+{
+	writer->buf[writer->len++] = *pp;
+	if (writer->len == PACKED_WRITER_LEN)
+		packed_flush(writer);
+}
+
+void packed_writer_close(struct PackedWriter* const writer)
+{
+	packed_flush(writer);
+	fclose(writer->file);
+	free(writer->buf);
+}
+
+// Move counters are compared within the range the packed format keeps
+static int same_pos(struct Position const * const a, struct Position const * const b)
+{
+	return !memcmp(a->bb, b->bb, sizeof(a->bb))
+	    && !memcmp(a->board, b->board, sizeof(a->board))
+	    && a->stm                       == b->stm
+	    && a->is_frc                    == b->is_frc
+	    && a->king_sq[WHITE]            == b->king_sq[WHITE]
+	    && a->king_sq[BLACK]            == b->king_sq[BLACK]
+	    && a->phase                     == b->phase
+	    && a->piece_psq_eval[WHITE]     == b->piece_psq_eval[WHITE]
+	    && a->piece_psq_eval[BLACK]     == b->piece_psq_eval[BLACK]
+	    && a->state->pos_key            == b->state->pos_key
+	    && a->state->pawn_key           == b->state->pawn_key
+	    && a->state->ep_sq_bb           == b->state->ep_sq_bb
+	    && a->state->castling_rights    == b->state->castling_rights
+	    && (a->state->fifty_moves > 255 ? 255 : a->state->fifty_moves)     == b->state->fifty_moves
+	    && (a->state->full_moves > 65535 ? 65535 : a->state->full_moves) == b->state->full_moves;
+}
+
+// Convert a FEN/EPD file, every position is checked to survive the round trip through the packed form.
+// Castling rights are read as Chess960 ones when is_frc is set.
+void pack_file(char const * const in_path, char const * const out_path, int is_frc)
+{
+	FILE* file = fopen(in_path, "r");
+	if (!file) {
+		fprintf(stdout, "info string Unable to open %s\n", in_path);
+		return;
+	}
+	struct PackedWriter writer;
+	if (packed_writer_open(&writer, out_path)) {
+		fprintf(stdout, "info string Unable to open %s\n", out_path);
+		fclose(file);
+		return;
+	}
+
+	u64 start = curr_time();
+	struct Position* pos      = malloc(sizeof(struct Position));
+	struct Position* copy_pos = malloc(sizeof(struct Position));
+	struct PackedPos pp;
+	char line[256];
+	u32 errors = 0;
+	while (fgets(line, sizeof(line), file)) {
+		if (line[0] == '\n' || line[0] == '\r' || line[0] == '#')
+			continue;
+		init_pos(pos);
+		pos->is_frc = is_frc;
+		set_pos(pos, line);
+		pack_pos(pos, &pp);
+		unpack_pos(copy_pos, &pp);
+		if (!same_pos(pos, copy_pos)) {
+			if (!errors)
+				fprintf(stdout, "info string Round trip mismatch: %s", line);
+			++errors;
+		}
+		packed_write(&writer, &pp);
+	}
+	packed_writer_close(&writer);
+	fclose(file);
+	free(copy_pos);
+	free(pos);
+	fprintf(stdout, "info string Packed %llu positions to %s in %llu ms, %u round trip errors\n",
+		writer.written, out_path, curr_time() - start, errors);
+}
+
+// Fixed round trip cases, the flag is UCI_Chess960
+static struct {
+	int is_frc;
+	char const* fen;
+} const pack_check_fens[] = {
+	{ 0, "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1" },
+	{ 0, "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3" },
+	{ 0, "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R b Kq - 17 42" },
+	{ 0, "r3k2r/8/8/8/8/8/8/R3K2R w Qk - 99 150" },
+	{ 0, "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 b - - 254 65535" },
+	{ 0, "4k3/8/8/8/8/8/8/4K3 w - - 300 70000" },
+	{ 1, "bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9" },
+	{ 1, "2nnrbkr/p1qppppp/8/1ppb4/6PP/3PP3/PPP2P2/BQNNRBKR b Eh - 1 9" },
+	{ 1, "1rqbkrbn/1ppppp1p/1n6/p1N3p1/8/2P4P/PP1PPPP1/1RQBKRBN w Fb - 0 9" },
+	{ 1, "rbbqn1kr/pp2p1pp/6n1/2pp1p2/2P4P/P7/BP1PPPP1/R1BQNNKR w HAha - 0 9" },
+};
+
+// The castling state and the legal moves must also match, a move string shows how castling is played
+static int same_play(struct Position* const a, struct Position* const b)
+{
+	int const rights = a->state->castling_rights;
+	struct Movelist list[2];
+	char mstr[2][6];
+	int cr, sq;
+	for (cr = 0; cr != 4; ++cr)
+		if (   (rights & (1 << cr))
+		    && a->castling_rook_pos[cr >> 1][cr & 1] != b->castling_rook_pos[cr >> 1][cr & 1])
+			return 0;
+	// Clearing a right that is not held does nothing
+	for (sq = 0; sq != 64; ++sq)
+		if ((a->castle_perms[sq] | ~rights & 15) != (b->castle_perms[sq] | ~rights & 15))
+			return 0;
+	for (int i = 0; i != 2; ++i) {
+		struct Position* pos = i ? b : a;
+		list[i].end = list[i].moves;
+		set_pinned(pos);
+		set_checkers(pos);
+		gen_legal_moves(pos, list + i);
+	}
+	if (list[0].end - list[0].moves != list[1].end - list[1].moves)
+		return 0;
+	for (u32 const *ma = list[0].moves, *mb = list[1].moves; ma != list[0].end; ++ma, ++mb) {
+		move_str(a, *ma, mstr[0]);
+		move_str(b, *mb, mstr[1]);
+		if (strcmp(mstr[0], mstr[1]))
+			return 0;
+	}
+	return 1;
+}
+
+// Returns the number of failed cases
+int pack_check()
+{
+	struct Position* pos      = malloc(sizeof(struct Position));
+	struct Position* copy_pos = malloc(sizeof(struct Position));
+	struct PackedPos pp;
+	char fen[128];
+	u32 i, failed = 0;
+	for (i = 0; i != arr_len(pack_check_fens); ++i) {
+		init_pos(pos);
+		pos->is_frc = pack_check_fens[i].is_frc;
+		strcpy(fen, pack_check_fens[i].fen);
+		set_pos(pos, fen);
+		pack_pos(pos, &pp);
+		unpack_pos(copy_pos, &pp);
+		if (!same_pos(pos, copy_pos) || !same_play(pos, copy_pos)) {
+			fprintf(stdout, "info string Pack round trip FAILED: %s\n", pack_check_fens[i].fen);
+			++failed;
+		}
+	}
+	fprintf(stdout, "pack check %s, %u of %u cases failed\n", failed ? "FAILED" : "passed",
+		failed, (u32) arr_len(pack_check_fens));
+	free(copy_pos);
+	free(pos);
+	return failed;
+}
@@ -0,0 +1,83 @@
+#ifndef PACKPOS_H
+#define PACKPOS_H
+
+/*
+ * WyldChess, a free UCI/Xboard compatible chess engine
+ * Copyright (C) 2016-2017 Manik Charan
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "position.h"
+
+#define PACKED_NO_EP       (64)
+#define PACKED_FRC         (16)  // Set in castling for a Chess960 position
+#define PACKED_WRITER_LEN  (4096)
+
+// Fixed size position record, files of these are plain arrays with no header
+struct PackedPos
+{
+	u64 occ;
+	u8  pieces[16];   // Nibble per occupied square in bitscan order, piece type | color << 3
+	u8  stm;
+	u8  castling;     // Castling rights, and PACKED_FRC
+	u8  ep_sq;        // PACKED_NO_EP when there is no en passant square
+	u8  fifty_moves;
+	u16 full_moves;
+	u16 rook_files;   // File of the castling rook for each castling right, 3 bits each
+};
+
+_Static_assert(sizeof(struct PackedPos) == 32, "PackedPos must be 32 bytes");
+
+// Self-play training record written by gensfen
+struct TrainingEntry
+{
+	struct PackedPos pos;
+	u32 move;
+	short score;  // Search score from the side to move's point of view
+	u8  result;   // 0, 1 or 2 half-points for white
+	u8  pad;
+};
+
+_Static_assert(sizeof(struct TrainingEntry) == 40, "TrainingEntry must be 40 bytes");
+
+struct PackedReader
+{
+	struct PackedPos const* data;
+	u64 count;
+	size_t size;
+};
+
+struct PackedWriter
+{
+	FILE* file;
+	struct PackedPos* buf;
+	u32 len;
+	u64 written;
+};
+
+extern void pack_pos(struct Position const * const pos, struct PackedPos* const pp);
+extern void unpack_pos(struct Position* const pos, struct PackedPos const * const pp);
+
+extern int packed_reader_open(struct PackedReader* const reader, char const * const path);
+extern void packed_reader_close(struct PackedReader* const reader);
+
+extern int packed_writer_open(struct PackedWriter* const writer, char const * const path);
+extern void packed_write(struct PackedWriter* const writer, struct PackedPos const * const pp);
+extern void packed_writer_close(struct PackedWriter* const writer);
+
+extern void pack_file(char const * const in_path, char const * const out_path, int is_frc);
+extern int pack_check();
+
+#endif
@@ -21,9 +21,6 @@
 #include "misc.h"
 
 int phase[8] = { 0, 0, 1, 10, 10, 20, 40, 0 };
-int is_frc = 0;
-int castling_rook_pos[2][2];
-u32 castle_perms[64];
 
 static inline u32 get_piece_from_char(char c)
 {
@@ -65,6 +62,10 @@ void get_position_copy(struct Position const * const pos, struct Position* const
 	copy_pos->phase = pos->phase;
 	copy_pos->piece_psq_eval[WHITE] = pos->piece_psq_eval[WHITE];
 	copy_pos->piece_psq_eval[BLACK] = pos->piece_psq_eval[BLACK];
+	copy_pos->eval_params = pos->eval_params;
+	copy_pos->is_frc = pos->is_frc;
+	memcpy(copy_pos->castling_rook_pos, pos->castling_rook_pos, sizeof(pos->castling_rook_pos));
+	memcpy(copy_pos->castle_perms, pos->castle_perms, sizeof(pos->castle_perms));
 	copy_pos->state = &copy_pos->hist[pos->state - pos->hist];
 	memcpy(copy_pos->state, pos->state, sizeof(struct State));
 }
@@ -89,6 +90,8 @@ void init_pos(struct Position* pos)
 	pos->state->castling_rights = 0;
 	pos->piece_psq_eval[WHITE]  = 0;
 	pos->piece_psq_eval[BLACK]  = 0;
+	pos->eval_params            = &eval_params;
+	pos->is_frc                 = 0;
 }
 
 int set_pos(struct Position* pos, char* fen)
@@ -100,7 +103,7 @@ int set_pos(struct Position* pos, char* fen)
 	pos->state->pos_key = 0ULL;
 	pos->state->pawn_key = 0ULL;
 	for (sq = 0; sq < 64; ++sq)
-		castle_perms[sq] = 15;
+		pos->castle_perms[sq] = 15;
 	while (tsq < 64) {
 		sq = tsq ^ 56;
 		c  = fen[index++];
@@ -117,14 +120,14 @@ int set_pos(struct Position* pos, char* fen)
 			put_piece(pos, sq, pt, pc);
 			if (pt == KING) {
 				pos->king_sq[pc] = sq;
-				castle_perms[sq] = pc == WHITE ? 12 : 3;
-			} else if (pt == ROOK && !is_frc) {
+				pos->castle_perms[sq] = pc == WHITE ? 12 : 3;
+			} else if (pt == ROOK && !pos->is_frc) {
 				if (sq == H1 || sq == H8) {
-					castling_rook_pos[pc][KINGSIDE] = sq;
-					castle_perms[sq] = pc == WHITE ? 14 : 11;
+					pos->castling_rook_pos[pc][KINGSIDE] = sq;
+					pos->castle_perms[sq] = pc == WHITE ? 14 : 11;
 				} else if (sq == A1 || sq == A8) {
-					castling_rook_pos[pc][QUEENSIDE] = sq;
-					castle_perms[sq] = pc == WHITE ? 13 : 7;
+					pos->castling_rook_pos[pc][QUEENSIDE] = sq;
+					pos->castle_perms[sq] = pc == WHITE ? 13 : 7;
 				}
 			}
 			++tsq;
@@ -139,7 +142,7 @@ int set_pos(struct Position* pos, char* fen)
 		if (c == '-') {
 			++index;
 			break;
-		} else if (!is_frc) {
+		} else if (!pos->is_frc) {
 			pos->state->castling_rights |= get_cr_from_char(c);
 		} else {
 			if (c >= 'a' && c <= 'z') {
@@ -165,23 +168,23 @@ int set_pos(struct Position* pos, char* fen)
 						break;
 				}
 				if (cr & (WKC | BKC)) {
-					castling_rook_pos[color][KINGSIDE] = kside_sq;
-					castle_perms[kside_sq] = color == WHITE ? 14 : 11;
+					pos->castling_rook_pos[color][KINGSIDE] = kside_sq;
+					pos->castle_perms[kside_sq] = color == WHITE ? 14 : 11;
 					pos->state->castling_rights |= color == WHITE ? WKC : BKC;
 				} else if (cr & (WQC | BQC)) {
-					castling_rook_pos[color][QUEENSIDE] = qside_sq;
-					castle_perms[qside_sq] = color == WHITE ? 13 : 7;
+					pos->castling_rook_pos[color][QUEENSIDE] = qside_sq;
+					pos->castle_perms[qside_sq] = color == WHITE ? 13 : 7;
 					pos->state->castling_rights |= color == WHITE ? WQC : BQC;
 				}
 			} else {
 				sq = get_sq(rank, file);
 				if (is_kingside(pos->king_sq[color], sq)) {
-					castling_rook_pos[color][KINGSIDE] = sq;
-					castle_perms[sq] = color == WHITE ? 14 : 11;
+					pos->castling_rook_pos[color][KINGSIDE] = sq;
+					pos->castle_perms[sq] = color == WHITE ? 14 : 11;
 					pos->state->castling_rights |= color == WHITE ? WKC : BKC;
 				} else if (is_queenside(pos->king_sq[color], sq)) {
-					castling_rook_pos[color][QUEENSIDE] = sq;
-					castle_perms[sq] = color == WHITE ? 13 : 7;
+					pos->castling_rook_pos[color][QUEENSIDE] = sq;
+					pos->castle_perms[sq] = color == WHITE ? 13 : 7;
 					pos->state->castling_rights |= color == WHITE ? WQC : BQC;
 				}
 			}
@@ -209,6 +212,112 @@ int set_pos(struct Position* pos, char* fen)
 	return index;
 }
 
+// set_pos trusts its input, so the board and the next three fields are checked first
+static int valid_fen(char const* p, int is_frc)
+{
+	int rank = 7, file = 0, pieces[2] = { 0, 0 }, pawns[2] = { 0, 0 }, kings[2] = { 0, 0 }, c;
+	for (; *p && *p != ' '; ++p) {
+		if (*p == '/') {
+			if (file != 8 || !rank--)
+				return 0;
+			file = 0;
+		} else if (*p > '0' && *p < '9') {
+			file += *p - '0';
+		} else if (strchr("pnbrqkPNBRQK", *p)) {
+			c = *p >= 'a' ? BLACK : WHITE;
+			++pieces[c];
+			pawns[c] += *p == 'p' || *p == 'P';
+			kings[c] += *p == 'k' || *p == 'K';
+			if (   (*p == 'p' || *p == 'P')
+			    && (rank == 0 || rank == 7))
+				return 0;
+			++file;
+		} else {
+			return 0;
+		}
+		if (file > 8)
+			return 0;
+	}
+	for (c = WHITE; c <= BLACK; ++c)
+		if (kings[c] != 1 || pawns[c] > 8 || pieces[c] > 16)
+			return 0;
+	if (rank || file != 8)
+		return 0;
+
+	// Side to move, castling rights and en passant square
+	if (   *p++ != ' '
+	    || (*p != 'w' && *p != 'b')
+	    || p[1] != ' ')
+		return 0;
+	char const ep_rank = *p == 'w' ? '6' : '3';
+	for (p += 2; *p && *p != ' '; ++p)
+		if (!strchr(is_frc ? "KQkqABCDEFGHabcdefgh-" : "KQkq-", *p))
+			return 0;
+	if (*p++ != ' ')
+		return 0;
+	if (*p == '-')
+		++p;
+	else if (p[0] >= 'a' && p[0] <= 'h' && p[1] == ep_rank)
+		p += 2;
+	else
+		return 0;
+	return !*p || *p == ' ';
+}
+
+// Sets up a position from a FEN that may come from anywhere, the move counters are optional.
+// Returns NULL, or what is wrong with the FEN.
+char const* set_pos_checked(struct Position* pos, char const * const fen)
+{
+	char buf[MAX_FEN_LEN + 8];
+	size_t const len = strlen(fen);
+	if (   len >= MAX_FEN_LEN
+	    || !valid_fen(fen, pos->is_frc))
+		return "invalid fen";
+	int spaces = 0;
+	for (char const* p = fen; *p; ++p)
+		spaces += *p == ' ';
+	memcpy(buf, fen, len);
+	strcpy(buf + len, spaces >= 5 ? "" : spaces == 4 ? " 1" : " 0 1");
+	set_pos(pos, buf);
+	if (atkers_to_sq(pos, pos->king_sq[!pos->stm], pos->stm, pos->bb[FULL]))
+		return "side not to move is in check";
+	if (   pos->state->ep_sq_bb
+	    && !(pawn_shift(pos->state->ep_sq_bb, !pos->stm) & pos->bb[PAWN] & pos->bb[!pos->stm]))
+		return "no pawn to capture en passant";
+	// Castling rights i belongs to color i / 2 on side i % 2
+	for (int cr = 0; cr != 4; ++cr) {
+		int c = cr >> 1, rsq = pos->castling_rook_pos[c][cr & 1];
+		if (   (pos->state->castling_rights & (1 << cr))
+		    && (   !(pos->bb[ROOK] & pos->bb[c] & BB(rsq))
+			||  rank_of(pos->king_sq[c]) != rank_of(rsq)
+			|| (!pos->is_frc && pos->king_sq[c] != (c == WHITE ? E1 : E8))))
+			return "castling rights without king and rook in place";
+	}
+	return NULL;
+}
+
+// Plays moves in UCI notation separated by white space, moves may be NULL. Returns NULL, or why a move
+// could not be played in which case the moves before it stay on the board.
+char const* play_moves(struct Position* pos, char const* moves)
+{
+	u32 move;
+	while (moves) {
+		while (*moves == ' ' || *moves == '\t' || *moves == '\r' || *moves == '\n')
+			++moves;
+		if (!*moves)
+			break;
+		if (pos->state - pos->hist >= MAX_MOVES_PER_GAME - 1)
+			return "game history full";
+		move = parse_move(pos, moves);
+		if (   !move
+		    || !legal_move(pos, move))
+			return "illegal move";
+		do_move(pos, move);
+		moves = strpbrk(moves, " \t\r\n");
+	}
+	return NULL;
+}
+
 static inline char get_char_from_piece(u32 piece, int c)
 {
 	char x;
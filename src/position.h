@@ -33,6 +33,8 @@ STATS(
 		u64 iid_tries;
 		u64 null_cutoffs;
 		u64 null_tries;
+		u64 probcut_cutoffs;
+		u64 probcut_tries;
 		u64 first_beta_cutoffs;
 		u64 beta_cutoffs;
 		u64 hash_probes;
@@ -73,15 +75,15 @@ struct Position
 	int board[64];
 	int phase;
 	int piece_psq_eval[2];
+	struct EvalParams const* eval_params;
+	int is_frc;  // Chess960 castling rights in the FEN and king takes rook castling moves
+	int castling_rook_pos[2][2];
+	u32 castle_perms[64];
 	struct State* state;
 	struct State hist[MAX_MOVES_PER_GAME + MAX_PLY];
 	STATS(struct Stats stats;)
 };
 
-extern int is_frc;
-extern int castling_rook_pos[2][2];
-extern u32 castle_perms[64];
-
 extern int psqt[2][8][64];
 extern int phase[8];
 
@@ -89,9 +91,12 @@ extern void init_eval_terms();
 extern void print_board(struct Position* pos);
 
 extern void performance_test(struct Position* const pos, u32 max_depth);
+extern void mate_search(struct Position* const pos, u32 max_moves, u64 max_nodes, u32 mb);
 
 extern void init_pos(struct Position* pos);
 extern int set_pos(struct Position* pos, char* fen);
+extern char const* set_pos_checked(struct Position* pos, char const * const fen);
+extern char const* play_moves(struct Position* pos, char const* moves);
 extern void get_position_copy(struct Position const * const pos, struct Position* const copy_pos);
 
 extern void do_null_move(struct Position* const pos);
@@ -104,9 +109,13 @@ extern void gen_captures(struct Position* pos, struct Movelist* list);
 extern void gen_quiesce_moves(struct Position* pos, struct Movelist* list);
 extern void gen_legal_moves(struct Position* pos, struct Movelist* list);
 extern void gen_check_evasions(struct Position* pos, struct Movelist* list);
+extern u32 parse_move(struct Position* const pos, char const * const str);
 
-extern int evaluate(struct Position* const pos);
-extern void tune();
+struct PT;
+extern int evaluate_pt(struct Position* const pos, struct PT* const pawn_table);
+extern int evaluate_trace(struct Position* const pos, struct EvalTrace* const trace);
+extern void tune(char const * const data_path, char const * const persona_path, int num_threads);
+extern void eval_batch(char const * const in_path, char const * const out_path, int num_threads);
 
 static inline int king_sq(struct Position const * const pos, int c)
 {
@@ -132,7 +141,7 @@ static inline void put_piece_no_key(struct Position* pos, u32 sq, u32 pt, u32 c)
 	pos->bb[pt]            |= set;
 	pos->board[sq]          = pt;
 	pos->phase             += phase[pt];
-	pos->piece_psq_eval[c] += piece_val[pt] + psqt[c][pt][sq];
+	pos->piece_psq_eval[c] += psqt[c][pt][sq];
 }
 
 static inline void remove_piece_no_key(struct Position* pos, u32 sq, u32 pt, u32 c)
@@ -143,7 +152,7 @@ static inline void remove_piece_no_key(struct Position* pos, u32 sq, u32 pt, u32
 	pos->bb[pt]            ^= clr;
 	pos->board[sq]          = 0;
 	pos->phase             -= phase[pt];
-	pos->piece_psq_eval[c] -= piece_val[pt] + psqt[c][pt][sq];
+	pos->piece_psq_eval[c] -= psqt[c][pt][sq];
 }
 
 static inline void move_piece(struct Position* pos, u32 from, u32 to, u32 pt, u32 c)
@@ -169,7 +178,7 @@ static inline void put_piece(struct Position* pos, u32 sq, u32 pt, u32 c)
 	pos->board[sq]          = pt;
 	pos->state->pos_key    ^= psq_keys[c][pt][sq];
 	pos->phase             += phase[pt];
-	pos->piece_psq_eval[c] += piece_val[pt] + psqt[c][pt][sq];
+	pos->piece_psq_eval[c] += psqt[c][pt][sq];
 	if (pt == PAWN)
 		pos->state->pawn_key ^= psq_keys[c][pt][sq];
 }
@@ -183,7 +192,7 @@ static inline void remove_piece(struct Position* pos, u32 sq, u32 pt, u32 c)
 	pos->board[sq]          = 0;
 	pos->state->pos_key    ^= psq_keys[c][pt][sq];
 	pos->phase             -= phase[pt];
-	pos->piece_psq_eval[c] -= piece_val[pt] + psqt[c][pt][sq];
+	pos->piece_psq_eval[c] -= psqt[c][pt][sq];
 	if (pt == PAWN)
 		pos->state->pawn_key ^= psq_keys[c][pt][sq];
 }
@@ -259,7 +268,7 @@ static inline u64 checkers(struct Position const * const pos, u32 by_color)
 		& pos->bb[by_color];
 }
 
-static inline u64 get_pinned(struct Position* const pos, int to_color)
+static inline u64 get_pinned(struct Position const * const pos, int to_color)
 {
 	u32 const ksq = king_sq(pos, to_color);
 	u32 sq;
@@ -338,6 +347,52 @@ static inline int legal_move(struct Position* const pos, u32 move)
 	}
 }
 
+enum Result {
+	NO_RESULT,
+	DRAW,
+	CHECKMATE
+};
+
+static inline int three_fold_repetition(struct Position* const pos)
+{
+	struct State* curr = pos->state;
+	struct State* ptr  = curr - 2;
+	struct State* end  = curr - curr->fifty_moves;
+	if (end < pos->hist)
+		end = pos->hist;
+	u32 repeats = 0;
+	for (; ptr >= end; ptr -= 2)
+		if (ptr->pos_key == curr->pos_key)
+			++repeats;
+	return repeats >= 2;
+}
+
+static inline int check_stale_and_mate(struct Position* const pos)
+{
+	struct Movelist list;
+	list.end = list.moves;
+	set_pinned(pos);
+	set_checkers(pos);
+	gen_pseudo_legal_moves(pos, &list);
+	u32* move;
+	for (move = list.moves; move != list.end; ++move) {
+		if (!legal_move(pos, *move))
+			continue;
+		return NO_RESULT;
+	}
+	return pos->state->checkers_bb ? CHECKMATE : DRAW;
+}
+
+// Result of the game in the current position, without reporting the reason
+static inline int game_result(struct Position* const pos)
+{
+	if (   pos->state->fifty_moves > 99
+	    || insufficient_material(pos)
+	    || three_fold_repetition(pos))
+		return DRAW;
+	return check_stale_and_mate(pos);
+}
+
 // Idea taken from Stockfish
 static inline int gives_check(struct Position const * const pos, u32 move)
 {
@@ -394,7 +449,7 @@ static inline int gives_check(struct Position const * const pos, u32 move)
 	}
 }
 
-static inline void move_str(u32 move, char str[6])
+static inline void move_str(struct Position const * const pos, u32 move, char str[6])
 {
 	u32 from = from_sq(move),
 	    to   = to_sq(move);
@@ -402,14 +457,14 @@ static inline void move_str(u32 move, char str[6])
 	str[1]   = rank_of(from) + '1';
 	str[2]   = file_of(to)   + 'a';
 	str[3]   = rank_of(to)   + '1';
-	if (is_frc && move_type(move) == CASTLE) {
+	if (pos->is_frc && move_type(move) == CASTLE) {
 		int c = rank_of(from) == RANK_1 ? WHITE : BLACK;
 		int cside;
 		if (c == WHITE)
 			cside = to == G1 ? KINGSIDE : QUEENSIDE;
 		else
 			cside = to == G8 ? KINGSIDE : QUEENSIDE;
-		str[2] = file_of(castling_rook_pos[c][cside]) + 'a';
+		str[2] = file_of(pos->castling_rook_pos[c][cside]) + 'a';
 	} else if (move_type(move) == PROMOTION) {
 		const u32 prom = prom_type(move);
 		switch (prom) {
@@ -433,54 +488,6 @@ static inline void move_str(u32 move, char str[6])
 	str[5] = '\0';
 }
 
-static inline u32 parse_move(struct Position* pos, char* str)
-{
-	u32 from  = (str[0] - 'a') + ((str[1] - '1') << 3),
-	    to    = (str[2] - 'a') + ((str[3] - '1') << 3);
-	char prom = str[4];
-	int c = pos->stm;
-
-	// If capturing a rook of our own color in FRC, return castling move
-	if (   is_frc
-	    && (BB(to) & pos->bb[c])
-	    && pos->board[from] == KING
-	    && pos->board[to] == ROOK)
-	{
-		return    castling_rook_pos[c][KINGSIDE] == to
-			? move_castle(from, (c == WHITE ? G1 : G8))
-			: move_castle(from, (c == WHITE ? C1 : C8));
-	}
-	int pr_t;
-	struct Movelist list;
-	list.end = list.moves;
-	set_pinned(pos);
-	set_checkers(pos);
-	gen_pseudo_legal_moves(pos, &list);
-	u32* move;
-	for(move = list.moves; move != list.end; ++move) {
-		if (is_frc && move_type(*move) == CASTLE)
-			continue;
-		if (   from_sq(*move) == from
-		    && to_sq(*move) == to) {
-			if (   pos->board[from] == PAWN
-			    && is_prom_sq[to]) {
-				pr_t = prom_type(*move);
-				if (prom == 'q' && pr_t == QUEEN)
-					return *move;
-				if (prom == 'n' && pr_t == KNIGHT)
-					return *move;
-				if (prom == 'b' && pr_t == BISHOP)
-					return *move;
-				if (prom == 'r' && pr_t == ROOK)
-					return *move;
-			} else {
-				return *move;
-			}
-		}
-	}
-	return 0;
-}
-
 static inline int is_passed_pawn(struct Position* const pos, int sq, int c)
 {
 	return (    (pos->board[sq] == PAWN)
@@ -23,12 +23,12 @@
 
 struct PTEntry
 {
-	int score_white;
-	int score_black;
-	u64 passed_pawn_white_bb;
-	u64 passed_pawn_black_bb;
-	u64 pawn_atks_white_bb;
-	u64 pawn_atks_black_bb;
+	int score[2];
+	// Shelter and storm score for a king on its back rank, per king file
+	int king_shelter[2][8];
+	u64 passed_pawn_bb[2];
+	u64 pawn_atks_bb[2];
+	u64 outpost_bb[2];
 	u64 key;
 };
 
@@ -38,8 +38,6 @@ struct PT
 	u32 size;
 };
 
-extern struct PT pt;
-
 static inline void pt_clear(struct PT* pt)
 {
 	memset(pt->table, 0, sizeof(struct PTEntry) * pt->size);
@@ -47,7 +45,7 @@ static inline void pt_clear(struct PT* pt)
 
 static inline void pt_alloc_MB(struct PT* pt, u32 size)
 {
-	size     *= 0x10000 / 3;
+	size     *= 0x100000 / sizeof(struct PTEntry);
 	size      = max(size, 1);
 	pt->table = (struct PTEntry*) realloc(pt->table, sizeof(struct PTEntry) * size);
 	pt->size  = size;
@@ -59,20 +57,12 @@ static inline void pt_destroy(struct PT* pt)
 	free(pt->table);
 }
 
-static inline void pt_store(struct PT* pt, int score_white, int score_black,
-			    u64 passed_pawn_white_bb, u64 passed_pawn_black_bb,
-			    u64 pawn_atks_white_bb, u64 pawn_atks_black_bb,
-			    u64 key)
+static inline void pt_store(struct PT* pt, struct PTEntry const * const new_entry, u64 key)
 {
 	u32 index = key < pt->size ? key : key % pt->size;
 	struct PTEntry* entry = pt->table + index;
-	entry->score_white = score_white;
-	entry->score_black = score_black;
-	entry->passed_pawn_white_bb = passed_pawn_white_bb;
-	entry->passed_pawn_black_bb = passed_pawn_black_bb;
-	entry->pawn_atks_white_bb = pawn_atks_white_bb;
-	entry->pawn_atks_black_bb = pawn_atks_black_bb;
-	entry->key = key ^ pawn_atks_white_bb ^ pawn_atks_black_bb;
+	memcpy(entry, new_entry, sizeof(struct PTEntry));
+	entry->key = key ^ new_entry->pawn_atks_bb[WHITE] ^ new_entry->pawn_atks_bb[BLACK];
 }
 
 // Return a value instead of reference for thread safety
@@ -16,27 +16,122 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <math.h>
 #include "search.h"
+#include "engine.h"
 #include "syzygy/tbprobe.h"
 
-#define HISTORY_LIM (8000)
-#define MAX_HISTORY_DEPTH (12)
+#define MAX_HISTORY_DEPTH (20)
 
-volatile int abort_search;
+#define piece_idx(pt, c) ((pt) - PAWN + 6 * (c))
+
+// Searches excluding a move store their results apart from those of the full position
+#define excluded_key(move) ((u64) (move) * 0x9E3779B97F4A7C15ULL)
+
+// Late move reductions in plies for [pv][depth][move number], growing with log(depth) * log(move number)
+static int reductions[2][64][64];
+
+void init_reductions()
+{
+	for (int depth = 1; depth < 64; ++depth) {
+		for (int move_num = 1; move_num < 64; ++move_num) {
+			double r = log(depth) * log(move_num);
+			reductions[0][depth][move_num] = (int) (lmr_base_non_pv / 100.0 + r * 100.0 / lmr_div_non_pv);
+			reductions[1][depth][move_num] = (int) (lmr_base_pv / 100.0 + r * 100.0 / lmr_div_pv);
+		}
+	}
+}
+
+// The continuation history is too large to be part of every search unit and to be copied into the
+// helpers on each search, so it is allocated apart and each unit keeps its own. Returns 1 when out
+// of memory.
+int alloc_search_locals(struct SearchLocals* const sl)
+{
+	sl->cont_history = calloc(12, sizeof(*sl->cont_history));
+	return !sl->cont_history;
+}
+
+void destroy_search_locals(struct SearchLocals* const sl)
+{
+	free(sl->cont_history);
+	sl->cont_history = NULL;
+}
 
 void init_search(struct SearchLocals* const sl)
 {
-	memset(sl->history, 0, sizeof(int) * 8 * 64);
-	memset(sl->counter_move_table, 0, sizeof(u32) * 64 * 64);
+	memset(sl->history, 0, sizeof(sl->history));
+	memset(sl->cap_history, 0, sizeof(sl->cap_history));
+	memset(sl->cont_history, 0, 12 * sizeof(*sl->cont_history));
+	memset(sl->corr_history, 0, sizeof(sl->corr_history));
+	memset(sl->counter_move_table, 0, sizeof(sl->counter_move_table));
+}
+
+// Gravity update, an entry moves towards +-history_limit more slowly the closer it gets
+static inline void update_history(int* const entry, int bonus)
+{
+	*entry += bonus - *entry * abs(bonus) / history_limit;
+}
+
+static inline int* corr_history_entry(struct Position const * const pos, struct SearchLocals* const sl)
+{
+	return &sl->corr_history[pos->stm][pos->state->pawn_key & (CORR_HIST_SIZE - 1)];
+}
+
+// Moving average of search result minus static eval, deeper results weigh more
+static void update_corr_history(struct Position const * const pos, struct SearchLocals* const sl, int diff, int depth)
+{
+	int* entry = corr_history_entry(pos, sl);
+	int weight = min(depth + 1, 16);
+	*entry = (*entry * (256 - weight) + diff * CORR_HIST_GRAIN * weight) / 256;
+	*entry = max(-CORR_HIST_MAX, min(CORR_HIST_MAX, *entry));
+}
+
+static inline int history_bonus(int depth)
+{
+	depth = min(depth, MAX_HISTORY_DEPTH);
+	return 32 * depth * depth;
+}
+
+static inline int captured_type(struct Position const * const pos, u32 move)
+{
+	return move_type(move) == ENPASSANT ? PAWN : pos->board[to_sq(move)];
+}
+
+static inline int* cap_history_entry(struct Position const * const pos, struct SearchLocals* const sl, u32 move)
+{
+	return &sl->cap_history[piece_idx(pos->board[from_sq(move)], pos->stm)][to_sq(move)][captured_type(pos, move)];
+}
+
+// Butterfly history plus the continuation histories of the moves one and two plies back
+static int quiet_history(struct Position const * const pos, struct SearchStack const * const ss,
+			 struct SearchLocals const * const sl, u32 move)
+{
+	int from = from_sq(move), to = to_sq(move);
+	int piece = piece_idx(pos->board[from], pos->stm);
+	int val = sl->history[pos->stm][from][to];
+	if (ss->ply >= 1 && (ss - 1)->cont_hist)
+		val += (ss - 1)->cont_hist[piece][to];
+	if (ss->ply >= 2 && (ss - 2)->cont_hist)
+		val += (ss - 2)->cont_hist[piece][to];
+	return val;
+}
+
+static void update_quiet_history(struct Position const * const pos, struct SearchStack* const ss,
+				 struct SearchLocals* const sl, u32 move, int bonus)
+{
+	int from = from_sq(move), to = to_sq(move);
+	int piece = piece_idx(pos->board[from], pos->stm);
+	update_history(&sl->history[pos->stm][from][to], bonus);
+	if (ss->ply >= 1 && (ss - 1)->cont_hist)
+		update_history(&(ss - 1)->cont_hist[piece][to], bonus);
+	if (ss->ply >= 2 && (ss - 2)->cont_hist)
+		update_history(&(ss - 2)->cont_hist[piece][to], bonus);
 }
 
-static void reduce_history(struct SearchLocals* const sl)
+static inline void set_cont_hist(struct Position const * const pos, struct SearchStack* const ss,
+				 struct SearchLocals* const sl, u32 move)
 {
-	int pt, sq, c;
-	for (pt = PAWN; pt <= KING; ++pt)
-		for (c = WHITE; c <= BLACK; ++c)
-			for (sq = 0; sq < 64; ++sq)
-				sl->history[pt][sq] /= 16;
+	ss->cont_hist = sl->cont_history[piece_idx(pos->board[from_sq(move)], pos->stm)][to_sq(move)];
 }
 
 static void order_moves(struct Position* const pos, struct SearchStack* const ss, struct SearchLocals* const sl, u32 tt_move)
@@ -56,7 +151,7 @@ static void order_moves(struct Position* const pos, struct SearchStack* const ss
 			*order = HASH_MOVE;
 		} else if (   cap_type(*move)
 			   || move_type(*move) == ENPASSANT) {
-			*order = cap_order(pos, *move);
+			*order = cap_order(pos, *move) + *cap_history_entry(pos, sl, *move) / 64;
 		} else {
 			if (*move == ss->killers[0])
 				*order = KILLER + 1;
@@ -69,7 +164,7 @@ static void order_moves(struct Position* const pos, struct SearchStack* const ss
 				*order = COUNTER;
 
 			else
-				*order = sl->history[pos->board[from_sq(*move)]][to_sq(*move)];
+				*order = quiet_history(pos, ss, sl, *move);
 		}
 	}
 }
@@ -101,17 +196,18 @@ static int qsearch(struct SearchUnit* const su, struct SearchStack* const ss, in
 {
 	su->counter += (su->type == MAIN);
 
+	struct Position* const pos = &su->pos;
+	struct Controller* const ctlr = su->ctlr;
+	struct SearchLocals* const sl = &su->sl;
+
 	if (     su->type == MAIN
 	    && !(su->counter & 0x7ff)
 	    &&   stopped(su)) {
-		abort_search = 1;
+		ctlr->abort_search = 1;
 		return 0;
 	}
 
-	struct Position* const pos = &su->pos;
-	struct Controller* const ctlr = &controller;
-	struct SearchLocals* const sl = &su->sl;
-	++ctlr->nodes_searched[su - search_units];
+	++ctlr->nodes_searched[su->id];
 
 	if (pos->state->fifty_moves > 99)
 		return 0;
@@ -121,7 +217,7 @@ static int qsearch(struct SearchUnit* const su, struct SearchStack* const ss, in
 		return 0;
 
 	if (ss->ply >= MAX_PLY)
-		return evaluate(pos);
+		return evaluate_pt(pos, ctlr->pt);
 
 	// Mate distance pruning
 	alpha = max((-MATE + ss->ply), alpha);
@@ -134,7 +230,7 @@ static int qsearch(struct SearchUnit* const su, struct SearchStack* const ss, in
 	int eval = 0;
 
 	if (!checked) {
-		eval = evaluate(pos);
+		eval = evaluate_pt(pos, ctlr->pt);
 		if (eval >= beta)
 			return eval;
 		if (eval > alpha)
@@ -168,17 +264,18 @@ static int qsearch(struct SearchUnit* const su, struct SearchStack* const ss, in
 		if (   !checked
 		    &&  alpha > -MAX_MATE_VAL
 		    && !gives_check(pos, move)) {
-			val = eval + mg_val(piece_val[cap_type(move)]) + (mg_val(piece_val[PAWN]) / 2);
+			val = eval + mg_val(pos->eval_params->piece_val[cap_type(move)]) + (mg_val(pos->eval_params->piece_val[PAWN]) / 2);
 			if (move_type(move) == PROMOTION)
-				val += mg_val(piece_val[prom_type(move)]);
+				val += mg_val(pos->eval_params->piece_val[prom_type(move)]);
 			if (val <= alpha)
 				continue;
 		}
 
+		set_cont_hist(pos, ss, sl, move);
 		do_move(pos, move);
 		val = -qsearch(su, ss + 1, -beta, -alpha);
 		undo_move(pos);
-		if (ctlr->is_stopped || abort_search)
+		if (ctlr->is_stopped || ctlr->abort_search)
 			return 0;
 		if (val >= beta) {
 			STATS(
@@ -197,21 +294,25 @@ static int qsearch(struct SearchUnit* const su, struct SearchStack* const ss, in
 
 static int search_move(struct SearchUnit* su, struct SearchStack* ss, struct SearchLocals* sl, int best_val,
 		       int alpha, int beta, int checked, int depth, u32 move, int move_num, int node_type,
-		       u64 non_pawn_pieces_count, int static_eval, u32 counter_move)
+		       u64 non_pawn_pieces_count, int static_eval, int improving, u32 counter_move,
+		       int extension)
 {
 
-	int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha, int beta, int depth);
-	struct Controller* ctlr = &controller;
+	struct Controller* ctlr = su->ctlr;
 
+	// After the first second, at most one currmove line per interval
 	if (  !ss->ply
 	    && su->type == MAIN
 	    && su->protocol == UCI) {
 		u64 time_passed = curr_time() - ctlr->search_start_time;
-		if (time_passed >= 1000ULL) {
+		if (   time_passed >= 1000ULL
+		    && time_passed >= su->currmove_time + CURRMOVE_INTERVAL) {
 			char mstr[6];
-			move_str(move, mstr);
-			fprintf(stdout, "info currmovenumber %d currmove %s nps %llu\n",
-				move_num, mstr, total_nodes_searched() * 1000 / time_passed);
+			move_str(&su->pos, move, mstr);
+			out_printf("info currmovenumber %d currmove %s nps %llu\n",
+				   move_num, mstr, total_nodes_searched(ctlr) * 1000 / time_passed);
+			out_flush();
+			su->currmove_time = time_passed;
 		}
 	}
 
@@ -222,8 +323,9 @@ static int search_move(struct SearchUnit* su, struct SearchStack* ss, struct Sea
 
 	// Check extension
 	if (    checking_move
-	    && (depth == 1 || see(pos, to_sq(move)) > -equal_cap_bound))
-		++depth_left;
+	    && (depth == 1 || see_ge(pos, move, 1 - equal_cap_bound)))
+		extension = 1;
+	depth_left += extension;
 
 	// Heuristic pruning and reductions
 	if (    ss->ply
@@ -235,40 +337,39 @@ static int search_move(struct SearchUnit* su, struct SearchStack* ss, struct Sea
 	    && !cap_type(move)) {
 
 		// Futility pruning
-		if (   depth < 8
+		if (   depth < futility_depth
 		    && node_type != PV_NODE
-		    && static_eval + 100 * depth_left <= alpha)
+		    && static_eval + futility_margin * depth_left <= alpha)
 			return -INFINITY;
 
 		// Prune moves with horrible SEE at low depth(idea from Stockfish)
-		if (   depth < 8
-		    && see(pos, move) < -10 * depth * depth)
+		if (   depth < see_prune_depth
+		    && !see_ge(pos, move, -see_prune_factor * depth * depth))
 			return -INFINITY;
 
 		int passer_move = is_passed_pawn(pos, from_sq(move), pos->stm)
 			  && (pos->stm == WHITE ? rank_of(to_sq(move)) >= RANK_6 : rank_of(to_sq(move)) <= RANK_3);
 
 		// Late move reduction
-		if (    depth > 2
-		    &&  move_num > (node_type == PV_NODE ? 5 : 3)
+		if (    depth >= lmr_min_depth
+		    &&  move_num > (node_type == PV_NODE ? lmr_pv_move_num : lmr_non_pv_move_num)
 		    &&  move != ss->killers[0]
 		    &&  move != ss->killers[1]
 		    &&  move != counter_move
 		    && !passer_move
 		    && !checked) {
-			int reduction = 2;
-			int hist_val = sl->history[pos->board[from_sq(move)]][to_sq(move)];
-			reduction += (move_num > 10)
-				   + (node_type != PV_NODE)
-				   + (hist_val < -500)
-				   + (hist_val < -3000)
-				   - (hist_val > 500)
-				   - (hist_val > 3000);
-			depth_left = max(1, depth - max(2, reduction));
+			int hist_val  = quiet_history(pos, ss, sl, move);
+			int reduction = reductions[node_type == PV_NODE][min(depth, 63)][min(move_num, 63)];
+			reduction += !improving
+				   + (node_type == CUT_NODE)
+				   - max(-2, min(2, hist_val / lmr_hist_div));
+			depth_left = max(1, depth - 1 - max(1, reduction));
 		}
 	}
 
-	ss[1].pv_depth = 0;
+	ss[1].pv_depth      = 0;
+	ss[1].excluded_move = 0;
+	set_cont_hist(pos, ss, sl, move);
 	do_move(pos, move);
 
 	int val;
@@ -311,9 +412,9 @@ int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha,
 	}
 
 	struct Position* const pos = &su->pos;
-	struct Controller* const ctlr = &controller;
+	struct Controller* const ctlr = su->ctlr;
 	struct SearchLocals* const sl = &su->sl;
-	++ctlr->nodes_searched[su - search_units];
+	++ctlr->nodes_searched[su->id];
 	int old_alpha = alpha;
 	su->counter += (su->type == MAIN);
 
@@ -324,7 +425,7 @@ int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha,
 		if (     su->type == MAIN
 		    && !(su->counter & 0x7ff)
 		    &&   stopped(su)) {
-			abort_search = 1;
+			ctlr->abort_search = 1;
 			return 0;
 		}
 
@@ -333,7 +434,7 @@ int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha,
 			return 0;
 
 		if (ss->ply >= MAX_PLY)
-			return evaluate(pos);
+			return evaluate_pt(pos, ctlr->pt);
 
 		// Mate distance pruning
 		alpha = max((-MATE + ss->ply), alpha);
@@ -343,12 +444,13 @@ int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha,
 	}
 
 	int node_type = ss->node_type;
+	u64 key = pos->state->pos_key ^ (ss->excluded_move ? excluded_key(ss->excluded_move) : 0ULL);
 
 	// Probe TT
 	STATS(++pos->stats.hash_probes;)
-	struct TTEntry entry = tt_probe(&tt, pos->state->pos_key);
+	struct TTEntry entry = tt_probe(ctlr->tt, key);
 	u32 tt_move = 0;
-	if ((entry.key ^ entry.data) == pos->state->pos_key) {
+	if ((entry.key ^ entry.data) == key) {
 		STATS(++pos->stats.hash_hits;)
 		tt_move = get_move(entry.data);
 		if (   node_type != PV_NODE
@@ -368,6 +470,7 @@ int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha,
 	// No castling allowed
 	// No fifty moves allowed
 	if (    TB_LARGEST > 0
+	    && !ss->excluded_move
 	    && !pos->state->castling_rights
 	    && !pos->state->fifty_moves
 	    &&  popcnt(pos->bb[FULL]) <= TB_LARGEST) {
@@ -380,7 +483,7 @@ int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha,
 							ep_sq, pos->stm == WHITE);
 			if (wdl != TB_RESULT_FAILED) {
 				++sl->tb_hits;
-				tt_store(&tt, tb_values[wdl], FLAG_EXACT, min(depth + 6, MAX_PLY - 1), 0, pos->state->pos_key);
+				tt_store(ctlr->tt, tb_values[wdl], FLAG_EXACT, min(depth + 6, MAX_PLY - 1), 0, key);
 				return tb_values[wdl];
 			}
 		} else {
@@ -412,7 +515,7 @@ int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha,
 				ss->pv[0] = move;
 				ss->pv_depth = 1;
 				ctlr->is_stopped = 1;
-				abort_search = 1;
+				ctlr->abort_search = 1;
 				return tb_values[TB_GET_WDL(res)];
 			}
 		}
@@ -420,12 +523,33 @@ int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha,
 
 	set_checkers(pos);
 	int checked = pos->state->checkers_bb > 0ULL;
-	int static_eval = 0;
-	if (node_type != PV_NODE)
-		static_eval = evaluate(pos);
+	// Static eval corrected by how far off it has been in this pawn structure
+	int raw_eval    = evaluate_pt(pos, ctlr->pt);
+	int static_eval = raw_eval + *corr_history_entry(pos, sl) / CORR_HIST_GRAIN;
+	static_eval     = max(-WINNING_SCORE + 1, min(WINNING_SCORE - 1, static_eval));
+	ss->static_eval = checked ? INVALID : static_eval;
+
+	// Improving when the static eval rose over our previous move, assumed when it is not known
+	int improving =   ss->ply < 2
+			|| (ss - 2)->static_eval == INVALID
+			||  static_eval > (ss - 2)->static_eval;
 
 	int non_pawn_pieces_count = popcnt((pos->bb[pos->stm] & ~(pos->bb[KING] ^ pos->bb[PAWN])));
 
+	// Razoring
+	// Far below alpha at low depth only captures can save the node, so let qsearch decide
+	if (    node_type != PV_NODE
+	    && !checked
+	    && !ss->excluded_move
+	    &&  depth <= razor_depth
+	    &&  static_eval + razor_margin * depth <= alpha) {
+		int val = qsearch(su, ss, alpha, alpha + 1);
+		if (ctlr->is_stopped || ctlr->abort_search)
+			return 0;
+		if (val <= alpha)
+			return val;
+	}
+
 	// Forward pruning
 	if (    node_type != PV_NODE
 	    &&  non_pawn_pieces_count
@@ -433,24 +557,27 @@ int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha,
 	    &&  ss->forward_prune) {
 
 		// Futility pruning
-		if (   depth < 3
+		if (   depth < rev_futility_depth
 		    && static_eval < WINNING_SCORE
-		    && static_eval - 200 * depth >= beta)
+		    && static_eval - rev_futility_margin * depth >= beta)
 			return static_eval;
 
 		// Null move pruning
-		if (   depth >= 4
+		if (   depth >= null_min_depth
 		    && node_type == CUT_NODE
+		    && !ss->excluded_move
 		    && static_eval >= beta) {
 			STATS(++pos->stats.null_tries;)
-			int reduction       = 4 + min(3, max(0, (static_eval - beta) / mg_val(piece_val[PAWN])));
+			int reduction       = null_base_reduction + min(null_eval_reduction, max(0, (static_eval - beta) / mg_val(pos->eval_params->piece_val[PAWN])));
 			int depth_left      = max(1, depth - reduction);
 			ss[1].node_type     = ALL_NODE;
 			ss[1].forward_prune = 0;
+			ss[1].excluded_move = 0;
+			ss->cont_hist       = NULL;
 			do_null_move(pos);
 			int val = -search(su, ss + 1, -beta, -beta + 1, depth_left);
 			undo_null_move(pos);
-			if (ctlr->is_stopped || abort_search)
+			if (ctlr->is_stopped || ctlr->abort_search)
 				return 0;
 			if (val >= beta) {
 				STATS(
@@ -467,12 +594,57 @@ int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha,
 		}
 	}
 
+	// ProbCut(idea from Stockfish)
+	// A capture beating beta by a margin in a shallow search, verified by qsearch first,
+	// would very likely beat beta in the full depth search too
+	int pc_beta = beta + probcut_margin;
+	if (    node_type != PV_NODE
+	    &&  depth >= probcut_depth
+	    && !checked
+	    && !ss->excluded_move
+	    &&  abs(beta) < WINNING_SCORE
+	    && !(   tt_move
+		 && DEPTH(entry.data) >= depth - 3
+		 && val_from_tt(SCORE(entry.data), ss->ply) < pc_beta)) {
+		STATS(++pos->stats.probcut_tries;)
+		struct Movelist* list = &ss->list;
+		list->end = list->moves;
+		set_pinned(pos);
+		gen_quiesce_moves(pos, list);
+		order_moves(pos, ss, sl, tt_move);
+		int move_num = 0;
+		u32 move;
+		while ((move = get_next_move(ss, move_num++))) {
+			if (   !legal_move(pos, move)
+			    || !see_ge(pos, move, pc_beta - static_eval))
+				continue;
+			ss[1].node_type     = ALL_NODE;
+			ss[1].forward_prune = 1;
+			ss[1].excluded_move = 0;
+			ss[1].pv_depth      = 0;
+			set_cont_hist(pos, ss, sl, move);
+			do_move(pos, move);
+			int val = -qsearch(su, ss + 1, -pc_beta, -pc_beta + 1);
+			if (val >= pc_beta)
+				val = -search(su, ss + 1, -pc_beta, -pc_beta + 1, depth - 4);
+			undo_move(pos);
+			if (ctlr->is_stopped || ctlr->abort_search)
+				return 0;
+			if (val >= pc_beta) {
+				STATS(++pos->stats.probcut_cutoffs;)
+				tt_store(ctlr->tt, val_to_tt(val, ss->ply), FLAG_LOWER, depth - 3, move, key);
+				return val;
+			}
+		}
+	}
+
 	// Internal iterative deepening
 	// Conditions similar to stockfish as of now, seems to be effective
 	STATS(int iid = 0;)
 	if (   !tt_move
+	    && !ss->excluded_move
 	    &&  depth >= 5
-	    && (node_type == PV_NODE || static_eval + mg_val(piece_val[PAWN]) >= beta)) {
+	    && (node_type == PV_NODE || static_eval + mg_val(pos->eval_params->piece_val[PAWN]) >= beta)) {
 		STATS(
 			iid = 1;
 			++pos->stats.iid_tries;
@@ -484,10 +656,37 @@ int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha,
 		search(su, ss, alpha, beta, depth - reduction);
 		ss->forward_prune = ep;
 
-		entry   = tt_probe(&tt, pos->state->pos_key);
+		entry   = tt_probe(ctlr->tt, key);
 		tt_move = get_move(entry.data);
 	}
 
+	// Singular extension(idea from Stockfish)
+	// The TT move is extended when all the others fail low against a bound below its score,
+	// if even that bound fails high several moves beat beta and the node is cut
+	int extension = 0;
+	if (    depth >= singular_depth
+	    &&  ss->ply
+	    &&  tt_move
+	    && !ss->excluded_move
+	    &&  (entry.key ^ entry.data) == key
+	    &&  FLAG(entry.data) != FLAG_UPPER
+	    &&  DEPTH(entry.data) >= depth - 3
+	    &&  abs(SCORE(entry.data)) < WINNING_SCORE) {
+		int s_beta        = SCORE(entry.data) - singular_margin * depth;
+		ss->excluded_move = tt_move;
+		ss->node_type     = node_type == PV_NODE ? CUT_NODE : node_type;
+		int val = search(su, ss, s_beta - 1, s_beta, (depth - 1) / 2);
+		ss->excluded_move = 0;
+		ss->node_type     = node_type;
+		ss->pv_depth      = 0;
+		if (ctlr->is_stopped || ctlr->abort_search)
+			return 0;
+		if (val < s_beta)
+			extension = 1;
+		else if (s_beta >= beta)
+			return s_beta;
+	}
+
 	struct Movelist* list = &ss->list;
 	list->end = list->moves;
 	set_pinned(pos);
@@ -497,6 +696,25 @@ int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha,
 	} else {
 		gen_legal_moves(pos, list);
 	}
+	if (ss->excluded_move) {
+		for (u32* curr = list->moves; curr < list->end; ++curr) {
+			if (*curr == ss->excluded_move) {
+				*curr = *--list->end;
+				break;
+			}
+		}
+	}
+	// The root moves of better MultiPV lines are left out
+	if (!ss->ply) {
+		for (u32 i = 0; i != ctlr->multipv_excluded_num; ++i) {
+			for (u32* curr = list->moves; curr < list->end; ++curr) {
+				if (*curr == ctlr->multipv_excluded[i]) {
+					*curr = *--list->end;
+					break;
+				}
+			}
+		}
+	}
 
 	order_moves(pos, ss, sl, tt_move);
 
@@ -504,19 +722,34 @@ int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha,
 	if (ss->ply)
 		counter_move = sl->counter_move_table[from_sq((pos->state-1)->move)][to_sq((pos->state-1)->move)];
 
+	// Move count pruning
+	// Once enough moves are searched at a low depth node the remaining quiet moves are skipped at once,
+	// they come last in the ordering so the loop ends at the first of them
+	int lmp_count = node_type != PV_NODE
+		     && !checked
+		     &&  non_pawn_pieces_count
+		     &&  depth <= lmp_depth
+		      ? (lmp_base + depth * depth) / (2 - improving)
+		      : MAX_MOVES_PER_POS;
+
 	int best_val    = -INFINITY,
 	    best_move   = 0,
 	    legal_moves = 0;
 	int val;
 	u32 move;
 	while ((move = get_next_move(ss, legal_moves))) {
+		if (   legal_moves >= lmp_count
+		    && best_val > -MAX_MATE_VAL
+		    && ss->order_arr[legal_moves] < QUIET_MAX)
+			break;
 		++legal_moves;
 
+		u64 nodes_before = ctlr->nodes_searched[su->id];
 		val = search_move(su, ss, sl, best_val, alpha, beta, checked, depth, move,
 				  legal_moves, node_type, non_pawn_pieces_count, static_eval,
-				  counter_move);
+				  improving, counter_move, move == tt_move ? extension : 0);
 
-		if (ctlr->is_stopped || abort_search)
+		if (ctlr->is_stopped || ctlr->abort_search)
 			return 0;
 
 		int quiet_move =   !cap_type(move)
@@ -526,6 +759,8 @@ int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha,
 		if (val > best_val) {
 			best_val  = val;
 			best_move = move;
+			if (!ss->ply)
+				su->best_move_nodes = ctlr->nodes_searched[su->id] - nodes_before;
 
 			if (node_type == PV_NODE) {
 				ss->pv[0] = move;
@@ -536,14 +771,6 @@ int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha,
 			if (val > alpha) {
 				alpha = val;
 
-				if (   quiet_move
-				    && depth <= MAX_HISTORY_DEPTH) {
-					int pt = pos->board[from_sq(move)];
-					sl->history[pt][to_sq(move)] += depth * depth;
-					if (sl->history[pt][to_sq(move)] > HISTORY_LIM)
-						reduce_history(sl);
-				}
-
 				if (val >= beta) {
 					STATS(
 						if (legal_moves == 1)
@@ -561,17 +788,17 @@ int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha,
 							sl->counter_move_table[from_sq(prev_move)][to_sq(prev_move)] = move;
 					}
 
-					if (depth <= MAX_HISTORY_DEPTH) {
-						for (u32* curr = list->moves + legal_moves - 2; curr >= list->moves; --curr) {
-							if (  !cap_type(*curr)
-							    && move_type(*curr) != ENPASSANT
-							    && prom_type(*curr) != QUEEN) {
-								int pt = pos->board[from_sq(*curr)];
-								sl->history[pt][to_sq(*curr)] -= depth * depth;
-								if (sl->history[pt][to_sq(*curr)] < -HISTORY_LIM)
-									reduce_history(sl);
-							}
-						}
+					// Reward the cutoff move and penalise the moves of its kind searched before it
+					int bonus = history_bonus(depth);
+					if (quiet_move)
+						update_quiet_history(pos, ss, sl, move, bonus);
+					else if (cap_type(move) || move_type(move) == ENPASSANT)
+						update_history(cap_history_entry(pos, sl, move), bonus);
+					for (u32* curr = list->moves + legal_moves - 2; curr >= list->moves; --curr) {
+						if (cap_type(*curr) || move_type(*curr) == ENPASSANT)
+							update_history(cap_history_entry(pos, sl, *curr), -bonus);
+						else if (quiet_move && prom_type(*curr) != QUEEN)
+							update_quiet_history(pos, ss, sl, *curr, -bonus);
 					}
 					break;
 				}
@@ -595,13 +822,16 @@ int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha,
 
 	if (   !ss->ply
 	    && !su->limited_moves_num
+	    && !ctlr->multipv_excluded_num
 	    &&  alpha < beta
 	    &&  legal_moves == 1) {
 		ctlr->is_stopped = 1;
-		abort_search = 1;
+		ctlr->abort_search = 1;
 	}
 
 	if (!legal_moves) {
+		if (ss->excluded_move)
+			return alpha;
 		if (checked)
 			return -MATE + ss->ply;
 		else
@@ -612,7 +842,21 @@ int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha,
 		 : best_val > old_alpha ? FLAG_EXACT
 		 : FLAG_UPPER;
 
-	tt_store(&tt, val_to_tt(best_val, ss->ply), flag, depth, best_move, pos->state->pos_key);
+	// A root searched without some of its moves would leave the wrong best move behind
+	if (ss->ply || !ctlr->multipv_excluded_num)
+		tt_store(ctlr->tt, val_to_tt(best_val, ss->ply), flag, depth, best_move, key);
+
+	// Learn from quiet positions whose result says something about the static eval
+	if (   !checked
+	    && !ss->excluded_move
+	    &&  abs(best_val) < WINNING_SCORE
+	    && !(    best_move
+		 && (   cap_type(best_move)
+		     || move_type(best_move) == ENPASSANT
+		     || move_type(best_move) == PROMOTION))
+	    && !(flag == FLAG_LOWER && best_val <= static_eval)
+	    && !(flag == FLAG_UPPER && best_val >= static_eval))
+		update_corr_history(pos, sl, best_val - raw_eval, depth);
 
 	return best_val;
 }
@@ -620,11 +864,12 @@ int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha,
 void* parallel_search(void* arg)
 {
 	struct SearchParams* params = (struct SearchParams*) arg;
+	struct Controller* const ctlr = params->su->ctlr;
 	params->result = INVALID;
 	int val = search(params->su, params->ss, params->alpha, params->beta, params->depth);
-	if (!abort_search) {
+	if (!ctlr->abort_search) {
 		params->result = val;
-		abort_search = 1;
+		ctlr->abort_search = 1;
 	}
 	return NULL;
 }
@@ -638,6 +883,10 @@ void print_stats(int thread_num, struct Position const * const pos)
 			((double)stats->iid_cutoffs) / stats->iid_tries);
 		fprintf(stdout, "null cutoff rate:         %lf\n",
 			((double)stats->null_cutoffs) / stats->null_tries);
+		fprintf(stdout, "probcut cutoff rate:      %lf\n",
+			((double)stats->probcut_cutoffs) / stats->probcut_tries);
+		fprintf(stdout, "probcut tries per node:   %lf\n",
+			((double)stats->probcut_tries) / stats->total_nodes);
 		fprintf(stdout, "hash hit rate:            %lf\n",
 			((double)stats->hash_hits) / stats->hash_probes);
 		fprintf(stdout, "pawn hash hit rate:       %lf\n",
@@ -656,15 +905,131 @@ void print_stats(int thread_num, struct Position const * const pos)
 	)
 }
 
-int begin_search(struct SearchUnit* const su)
+// Single threaded iterative deepening without output, for games played inside the engine.
+// Stops at ctlr->depth, after the iteration passing ctlr->node_limit or at ctlr->search_end_time.
+u32 search_silent(struct SearchUnit* const su, struct SearchStack* const ss, int* const score)
+{
+	struct Controller* const ctlr = su->ctlr;
+	u32 max_depth = ctlr->depth > MAX_PLY ? MAX_PLY : ctlr->depth;
+	u32 best_move = 0;
+	int val;
+	clear_search(su, ss);
+	su->max_searched_ply = 0;
+	ss->node_type        = PV_NODE;
+	ss->forward_prune    = 0;
+	for (u32 depth = 1; depth <= max_depth; ++depth) {
+		ctlr->abort_search = 0;
+		ss->pv_depth       = 0;
+		val = search(su, ss, -INFINITY, INFINITY, depth);
+		if (ss->pv_depth) {
+			best_move = ss->pv[0];
+			// An iteration cut short by the clock keeps the score of the last full one
+			if (   depth == 1
+			    || !ctlr->time_dependent
+			    ||  curr_time() < ctlr->search_end_time)
+				*score = val;
+		}
+		// A single legal move, a root TB hit or running out of time end the search
+		if (   ctlr->abort_search
+		    || (ctlr->node_limit && ctlr->nodes_searched[su->id] >= ctlr->node_limit))
+			break;
+	}
+	return best_move;
+}
+
+static void print_lines(struct SearchUnit* const su, int depth, int num_lines)
 {
-	u64 time;
-	int val, alpha, beta, depth;
-	int best_move = 0;
+	if (su->protocol == LIBRARY) {
+		report_info(su, depth, num_lines);
+		return;
+	}
+
+	struct Controller* const ctlr     = su->ctlr;
+	struct PVLine const * const lines = ctlr->engine->pv_lines;
+	u64 time = curr_time() - ctlr->search_start_time;
+	for (int i = 0; i != num_lines; ++i) {
+		int val = lines[i].val;
+		if (su->protocol == XBOARD) {
+		    out_printf("%3d %5d %5llu %9llu", depth, val, time / 10, total_nodes_searched(ctlr));
+		} else if (su->protocol == UCI) {
+		    out_printf("info ");
+		    out_printf("depth %u ", depth);
+		    out_printf("seldepth %u ", su->max_searched_ply);
+		    out_printf("multipv %d ", i + 1);
+		    out_printf("tbhits %llu ", su->sl.tb_hits);
+		    out_printf("score ");
+		    if (abs(val) < MAX_MATE_VAL) {
+			out_printf("cp %d ", val);
+		    } else {
+			out_printf("mate ");
+			if (val < 0)
+			    out_printf("%d ", (-val - MATE) / 2);
+			else
+			    out_printf("%d ", (-val + MATE + 1) / 2);
+		    }
+		    out_printf("nodes %llu ", total_nodes_searched(ctlr));
+		    if (time > 1000ULL)
+			out_printf("nps %llu ", total_nodes_searched(ctlr) * 1000 / time);
+		    out_printf("time %llu ", time);
+		    out_printf("pv");
+		}
+		print_pv_line(&su->pos, lines + i);
+		out_printf("\n");
+	}
+	out_flush();
+}
 
-	reduce_history(&su->sl);
+// Lines found later in an iteration can still score above earlier ones, keep them ranked
+static void sort_lines(struct PVLine* const lines, int num_lines)
+{
+	struct PVLine tmp;
+	for (int i = 1; i < num_lines; ++i) {
+		int j = i;
+		if (lines[j].val <= lines[j - 1].val)
+			continue;
+		tmp = lines[j];
+		for (; j > 0 && tmp.val > lines[j - 1].val; --j)
+			lines[j] = lines[j - 1];
+		lines[j] = tmp;
+	}
+}
 
-	struct SearchStack* ss = *search_stacks;
+// Ranks and prints the lines, returns the best move
+static u32 report_lines(struct SearchUnit* const su, int depth, int num_lines)
+{
+	struct PVLine* const lines = su->ctlr->engine->pv_lines;
+	sort_lines(lines, num_lines);
+	print_lines(su, depth, num_lines);
+	if (   lines[0].pv_depth > 1
+	    && legal_move(&su->pos, lines[0].pv[1]))
+		su->ponder_move = lines[0].pv[1];
+	return lines[0].pv_depth ? lines[0].pv[0] : 0;
+}
+
+static int root_moves_num(struct SearchUnit* const su)
+{
+	if (su->limited_moves_num)
+		return su->limited_moves_num;
+	struct Movelist list;
+	list.end = list.moves;
+	set_checkers(&su->pos);
+	set_pinned(&su->pos);
+	gen_legal_moves(&su->pos, &list);
+	return list.end - list.moves;
+}
+
+// With MultiPV each iteration searches the root once per line, leaving out the root moves of the lines
+// found before it. The TT and the histories are shared by all the lines.
+int begin_search(struct SearchUnit* const su)
+{
+	int val, alpha, beta, depth, line;
+	int best_move = 0, prev_best_move = 0, prev_val = 0, stable_iterations = 0, best_move_share = 0;
+	u64 root_nodes = 0;
+
+	struct Controller* const ctlr = su->ctlr;
+	struct Engine* const engine   = ctlr->engine;
+	struct PVLine* const pv_lines = engine->pv_lines;
+	struct SearchStack* ss = *engine->stacks;
 	clear_search(su, ss);
 
 	su->sl.tb_hits = 0ULL;
@@ -673,22 +1038,25 @@ int begin_search(struct SearchUnit* const su)
 	ss->node_type        = PV_NODE;
 	su->max_searched_ply = 0;
 
-	struct Controller* const ctlr = &controller;
 	int max_depth = ctlr->depth > MAX_PLY ? MAX_PLY : ctlr->depth;
-	static int deltas[] = { 10, 25, 50, 100, 200, INFINITY };
-	static int* alpha_delta;
-	static int* beta_delta;
+	int num_lines = max(1, min(engine->options[MULTI_PV], root_moves_num(su)));
+	int deltas[] = { aspiration_delta_1, aspiration_delta_2, aspiration_delta_3,
+			 aspiration_delta_4, aspiration_delta_5, INFINITY };
+	int* alpha_delta;
+	int* beta_delta;
 
-	int num_threads = spin_options[THREADS].curr_val - 1;
+	int num_threads = resize_units(engine, engine->options[THREADS]) - 1;
 	struct SearchUnit* su_tmp;
 	struct SearchStack *ss_tmp;
 	struct SearchParams* sp_tmp;
 	for (int i = 1; i <= num_threads; ++i) {
-		su_tmp = search_units + i;
-		ss_tmp = search_stacks[i];
-		sp_tmp = search_params + i;
+		su_tmp = engine->units[i];
+		ss_tmp = engine->stacks[i];
+		sp_tmp = engine->params + i;
 
+		// Helpers keep their continuation history from one search to the next
 		get_search_unit_copy(su, su_tmp);
+		su_tmp->id = i;
 		clear_search(su_tmp, ss_tmp);
 		su_tmp->type = HELPER;
 		su_tmp->max_searched_ply = 0;
@@ -699,97 +1067,115 @@ int begin_search(struct SearchUnit* const su)
 	}
 
 	for (depth = 1; depth <= max_depth; ++depth) {
-		alpha_delta = beta_delta = deltas;
-		if (depth < 5) {
-			alpha = -INFINITY;
-			beta  =  INFINITY;
-		} else {
-			alpha = max(val - *alpha_delta, -INFINITY);
-			beta  = min(val + *beta_delta, +INFINITY);
-		}
-		while (1) {
-			abort_search = 0;
-			ss = *search_stacks;
-			if (depth >= 5) {
-				for (int i = 1; i <= num_threads; ++i) {
-					sp_tmp = search_params + i;
-					sp_tmp->alpha = alpha;
-					sp_tmp->beta  = beta;
-					sp_tmp->depth = depth + (i & 1);
-					pthread_create(search_threads + i, NULL, parallel_search, sp_tmp);
-				}
+		ctlr->multipv_excluded_num = 0;
+		for (line = 0; line != num_lines; ++line) {
+			alpha_delta = beta_delta = deltas;
+			if (depth < aspiration_depth) {
+				alpha = -INFINITY;
+				beta  =  INFINITY;
+			} else {
+				val   = pv_lines[line].val;
+				alpha = max(val - *alpha_delta, -INFINITY);
+				beta  = min(val + *beta_delta, +INFINITY);
 			}
-			val = search(su, ss, alpha, beta, depth);
-			if (abort_search) {
+			while (1) {
+				ctlr->abort_search = 0;
+				ss = *engine->stacks;
+				ss->pv_depth = 0;
+				root_nodes   = ctlr->nodes_searched[su->id];
 				if (depth >= 5) {
 					for (int i = 1; i <= num_threads; ++i) {
-						pthread_join(search_threads[i], NULL);
-						su->sl.tb_hits += sp_tmp->su->sl.tb_hits;
-						sp_tmp = search_params + i;
-						if (sp_tmp->result != INVALID) {
-							val = sp_tmp->result;
-							ss = sp_tmp->ss;
-							su->max_searched_ply = sp_tmp->su->max_searched_ply;
+						sp_tmp = engine->params + i;
+						sp_tmp->alpha = alpha;
+						sp_tmp->beta  = beta;
+						sp_tmp->depth = depth + (i & 1);
+						pthread_create(engine->threads + i, NULL, parallel_search, sp_tmp);
+					}
+				}
+				val = search(su, ss, alpha, beta, depth);
+				if (ctlr->abort_search) {
+					if (depth >= 5) {
+						for (int i = 1; i <= num_threads; ++i) {
+							pthread_join(engine->threads[i], NULL);
+							su->sl.tb_hits += sp_tmp->su->sl.tb_hits;
+							sp_tmp = engine->params + i;
+							if (sp_tmp->result != INVALID) {
+								val = sp_tmp->result;
+								ss = sp_tmp->ss;
+								su->max_searched_ply = sp_tmp->su->max_searched_ply;
+							}
 						}
 					}
+				} else {
+					ctlr->abort_search = 1;
+					if (depth >= 5) {
+						for (int i = 1; i <= num_threads; ++i)
+							pthread_join(engine->threads[i], NULL);
+					}
 				}
-			} else {
-				abort_search = 1;
-				if (depth >= 5) {
-					for (int i = 1; i <= num_threads; ++i)
-						pthread_join(search_threads[i], NULL);
+
+				// The lines completed in this iteration are still reported
+				if (   depth > 1
+				    && ctlr->is_stopped) {
+					if (line)
+						best_move = report_lines(su, depth, line);
+					goto end_search;
+				}
+
+				if (val <= alpha) {
+					++alpha_delta;
+					alpha -= (alpha - val) + *alpha_delta;
+				} else if (val >= beta) {
+					++beta_delta;
+					beta += (val - beta) + *beta_delta;
+				} else {
+					break;
 				}
 			}
 
-			if (   depth > 1
-			    && ctlr->is_stopped)
-				goto end_search;
+			pv_lines[line].val      = val;
+			pv_lines[line].pv_depth = ss->pv_depth;
+			memcpy(pv_lines[line].pv, ss->pv, sizeof(u32) * ss->pv_depth);
+			ctlr->multipv_excluded[ctlr->multipv_excluded_num++] = get_pv_move(ss);
+			if (!line) {
+				root_nodes      = ctlr->nodes_searched[su->id] - root_nodes;
+				best_move_share = su->best_move_nodes * 100 / max(root_nodes, 1);
+			}
 
-			if (val <= alpha) {
-				++alpha_delta;
-				alpha -= (alpha - val) + *alpha_delta;
-			} else if (val >= beta) {
-				++beta_delta;
-				beta += (val - beta) + *beta_delta;
-			} else {
+			// A single legal move or a root TB hit stop the search after the first line
+			if (ctlr->is_stopped) {
+				++line;
 				break;
 			}
 		}
-
-		time = curr_time() - ctlr->search_start_time;
-		if (su->protocol == XBOARD) {
-		    fprintf(stdout, "%3d %5d %5llu %9llu", depth, val, time / 10, total_nodes_searched());
-		} else if (su->protocol == UCI) {
-		    fprintf(stdout, "info ");
-		    fprintf(stdout, "depth %u ", depth);
-		    fprintf(stdout, "seldepth %u ", su->max_searched_ply);
-		    fprintf(stdout, "tbhits %llu ", su->sl.tb_hits);
-		    fprintf(stdout, "score ");
-		    if (abs(val) < MAX_MATE_VAL) {
-			fprintf(stdout, "cp %d ", val);
-		    } else {
-			fprintf(stdout, "mate ");
-			if (val < 0)
-			    fprintf(stdout, "%d ", (-val - MATE) / 2);
-			else
-			    fprintf(stdout, "%d ", (-val + MATE + 1) / 2);
-		    }
-		    fprintf(stdout, "nodes %llu ", total_nodes_searched());
-		    if (time > 1000ULL)
-			fprintf(stdout, "nps %llu ", total_nodes_searched() * 1000 / time);
-		    fprintf(stdout, "time %llu ", time);
-		    fprintf(stdout, "pv");
+		best_move = report_lines(su, depth, line);
+
+		// Mate in n moves is a score of at least MATE - (2n - 1)
+		if (   ctlr->mate_moves
+		    && pv_lines[0].val >= MATE - 2 * (int) ctlr->mate_moves + 1)
+			break;
+
+		// Soft time limit
+		// A best move that keeps coming back and a score that holds stop early, a new best move,
+		// a falling score or nodes spread over many root moves extend the search up to the hard limit
+		stable_iterations = best_move == prev_best_move ? stable_iterations + 1 : 0;
+		if (   ctlr->time_dependent
+		    && ctlr->soft_time
+		    && depth >= tm_min_depth) {
+			int score_drop = max(-15, min(tm_score_drop_max, prev_val - pv_lines[0].val));
+			u64 soft_time  = ctlr->soft_time
+				       * (125 - tm_stable_step * min(stable_iterations, 10))
+				       * (100 + score_drop)
+				       * (tm_node_base - best_move_share) / 1000000;
+			if (curr_time() - ctlr->search_start_time >= soft_time)
+				break;
 		}
-		print_pv_line(ss);
-		fprintf(stdout, "\n");
-
-		best_move = get_pv_move(ss);
-		if (legal_move(&su->pos, ss->pv[1]))
-			su->ponder_move = ss->pv[1];
+		prev_best_move = best_move;
+		prev_val       = pv_lines[0].val;
 	}
 end_search:
 	for (int i = 0; i <= num_threads; ++i)
-		print_stats(i, &search_units[i].pos);
+		print_stats(i, &engine->units[i]->pos);
 
 	while (ctlr->analyzing)
 		continue;
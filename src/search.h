@@ -20,6 +20,7 @@
  */
 
 #include "search_unit.h"
+#include "search_tune.h"
 #include "tt.h"
 
 static int equal_cap_bound = 50;
@@ -43,20 +44,20 @@ static int min_attacker(struct Position const * const pos, int to, u64 const c_a
 }
 
 // Idea taken from Stockfish 6
-static int see(struct Position const * const pos, u32 move)
+static inline int see(struct Position const * const pos, u32 move)
 {
 	if (move_type(move) == CASTLE)
 		return 0;
 
 	int to = to_sq(move);
 	int swap_list[32];
-	swap_list[0] = mg_val(piece_val[pos->board[to]]);
+	swap_list[0] = mg_val(pos->eval_params->piece_val[pos->board[to]]);
 	int c = pos->stm;
 	int from = from_sq(move);
 	u64 occupied_bb = pos->bb[FULL] ^ BB(from);
 	if (move_type(move) == ENPASSANT) {
 		occupied_bb ^= BB((to - (c == WHITE ? 8 : -8)));
-		swap_list[0] = mg_val(piece_val[PAWN]) + 1;
+		swap_list[0] = mg_val(pos->eval_params->piece_val[PAWN]) + 1;
 	}
 	u64 atkers_bb = all_atkers_to_sq(pos, to, occupied_bb) & occupied_bb;
 	c = !c;
@@ -64,7 +65,7 @@ static int see(struct Position const * const pos, u32 move)
 	int cap = pos->board[from];
 	int i;
 	for (i = 1; c_atkers_bb;) {
-		swap_list[i] = -swap_list[i - 1] + mg_val(piece_val[cap]);
+		swap_list[i] = -swap_list[i - 1] + mg_val(pos->eval_params->piece_val[cap]);
 		cap = min_attacker(pos, to, c_atkers_bb, &occupied_bb, &atkers_bb);
 		if (cap == KING) {
 			if (c_atkers_bb == atkers_bb)
@@ -83,30 +84,77 @@ static int see(struct Position const * const pos, u32 move)
 	return swap_list[0];
 }
 
+// Whether the exchange on the target square wins at least threshold, exits as soon as the side to
+// recapture can not change the outcome. Idea from Stockfish
+static int see_ge(struct Position const * const pos, u32 move, int threshold)
+{
+	if (move_type(move) == CASTLE)
+		return threshold <= 0;
+
+	int to   = to_sq(move);
+	int from = from_sq(move);
+	int swap = mg_val(pos->eval_params->piece_val[pos->board[to]]) - threshold;
+	u64 occupied_bb = pos->bb[FULL] ^ BB(from);
+	if (move_type(move) == ENPASSANT) {
+		occupied_bb ^= BB((to - (pos->stm == WHITE ? 8 : -8)));
+		swap = mg_val(pos->eval_params->piece_val[PAWN]) - threshold;
+	}
+	if (swap < 0)
+		return 0;
+	swap = mg_val(pos->eval_params->piece_val[pos->board[from]]) - swap;
+	if (swap <= 0)
+		return 1;
+
+	// Pinned pieces only take part when the target square is on their pin line
+	u64 pinned_bb = get_pinned(pos, WHITE) | get_pinned(pos, BLACK);
+	u64 legal_bb  = ~0ULL;
+	int sq;
+	while (pinned_bb) {
+		sq         = bitscan(pinned_bb);
+		pinned_bb &= pinned_bb - 1;
+		if (!(BB(to) & dirn_sqs_bb[sq][king_sq(pos, (pos->bb[WHITE] & BB(sq)) ? WHITE : BLACK)]))
+			legal_bb ^= BB(sq);
+	}
+
+	u64 atkers_bb = all_atkers_to_sq(pos, to, occupied_bb) & occupied_bb;
+	u64 c_atkers_bb;
+	int c   = pos->stm;
+	int res = 1;
+	int cap;
+	while (1) {
+		c = !c;
+		c_atkers_bb = atkers_bb & pos->bb[c] & legal_bb;
+		if (!c_atkers_bb)
+			break;
+		res ^= 1;
+		// The x-rays behind the capturer are added to the attackers incrementally
+		cap = min_attacker(pos, to, c_atkers_bb, &occupied_bb, &atkers_bb);
+		if (cap == KING)
+			return (atkers_bb & pos->bb[!c] & legal_bb) ? res ^ 1 : res;
+		if ((swap = mg_val(pos->eval_params->piece_val[cap]) - swap) < res)
+			break;
+	}
+	return res;
+}
+
 static inline int cap_order(struct Position const * const pos, u32 const m)
 {
-	int cap_val   = mg_val(piece_val[pos->board[to_sq(m)]]);
+	int cap_val   = mg_val(pos->eval_params->piece_val[pos->board[to_sq(m)]]);
 	int capper_pt = pos->board[from_sq(m)];
 	if (move_type(m) == PROMOTION)
-		cap_val += mg_val(piece_val[prom_type(m)]);
-	int cap_diff = cap_val - mg_val(piece_val[capper_pt]);
+		cap_val += mg_val(pos->eval_params->piece_val[prom_type(m)]);
+	int cap_diff = cap_val - mg_val(pos->eval_params->piece_val[capper_pt]);
 	if (cap_diff > equal_cap_bound)
 		return GOOD_CAP + cap_val - capper_pt;
 	else if (cap_diff > -equal_cap_bound)
 		return GOOD_CAP + capper_pt;
 
-	int see_val = see(pos, m);
-	int cap_order;
-	if (see_val >= equal_cap_bound)
-		cap_order = GOOD_CAP;
-	else
-		cap_order = NGOOD_CAP;
-	return cap_order + see_val;
+	return see_ge(pos, m, equal_cap_bound) ? GOOD_CAP + cap_val - capper_pt : NGOOD_CAP + cap_diff;
 }
 
 static inline int stopped(struct SearchUnit* const su)
 {
-	struct Controller* ctlr = &controller;
+	struct Controller* ctlr = su->ctlr;
 	if (ctlr->is_stopped)
 		return 1;
 	if (   su->target_state != THINKING
@@ -119,6 +167,12 @@ static inline int stopped(struct SearchUnit* const su)
 		ctlr->is_stopped = 1;
 		return 1;
 	}
+	// Summed over the threads only here, every few thousand nodes of the main thread
+	if (   ctlr->max_nodes
+	    && total_nodes_searched(ctlr) >= ctlr->max_nodes) {
+		ctlr->is_stopped = 1;
+		return 1;
+	}
 
 	return 0;
 }
@@ -136,14 +190,14 @@ static inline int is_repeat(struct Position* const pos)
 	return 0;
 }
 
-static inline void print_pv_line(struct SearchStack* const ss)
+static inline void print_pv_line(struct Position const * const pos, struct PVLine const * const line)
 {
 	char mstr[6];
-	u32* curr = ss->pv;
-	u32* end  = ss->pv + ss->pv_depth;
+	u32 const* curr = line->pv;
+	u32 const* end  = line->pv + line->pv_depth;
 	for (; curr != end; ++curr) {
-		move_str(*curr, mstr);
-		fprintf(stdout, " %s", mstr);
+		move_str(pos, *curr, mstr);
+		out_printf(" %s", mstr);
 	}
 }
 
@@ -154,11 +208,14 @@ static inline u32 get_pv_move(struct SearchStack const * const ss)
 
 static inline void clear_search(struct SearchUnit* const su, struct SearchStack* const ss)
 {
-	struct Controller* const ctlr = &controller;
+	struct Controller* const ctlr = su->ctlr;
 	for (int i = 0; i < MAX_THREADS; ++i)
 		ctlr->nodes_searched[i] = 0ULL;
 	ctlr->is_stopped = 0;
+	ctlr->multipv_excluded_num = 0;
 	su->counter = 0;
+	su->currmove_time = 0;
+	ss->excluded_move = 0;
 	STATS(
 		struct Position* const pos    = &su->pos;
 		pos->stats.correct_nt_guess   = 0;
@@ -166,6 +223,8 @@ static inline void clear_search(struct SearchUnit* const su, struct SearchStack*
 		pos->stats.iid_tries          = 0;
 		pos->stats.null_cutoffs       = 0;
 		pos->stats.null_tries         = 0;
+		pos->stats.probcut_cutoffs    = 0;
+		pos->stats.probcut_tries      = 0;
 		pos->stats.first_beta_cutoffs = 0;
 		pos->stats.beta_cutoffs       = 0;
 		pos->stats.hash_probes        = 0;
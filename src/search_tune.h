@@ -0,0 +1,92 @@
+#ifndef SEARCH_TUNE_H
+#define SEARCH_TUNE_H
+
+/*
+ * WyldChess, a free UCI/Xboard compatible chess engine
+ * Copyright (C) 2016-2017 Manik Charan
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Search parameters: variable, UCI option name, default, min, max. The LMR bases and divisors are in hundredths.
+// A TUNE_BUILD exposes them as spin options for SPSA, otherwise they are compile time constants.
+#define SEARCH_TUNABLES \
+	X(futility_depth,         "FutilityDepth",          8,    1,    16) \
+	X(futility_margin,        "FutilityMargin",         100,  0,    400) \
+	X(rev_futility_depth,     "RevFutilityDepth",       3,    1,    10) \
+	X(rev_futility_margin,    "RevFutilityMargin",      200,  0,    600) \
+	X(see_prune_depth,        "SeePruneDepth",          8,    1,    16) \
+	X(see_prune_factor,       "SeePruneFactor",         10,   0,    50) \
+	X(null_min_depth,         "NullMinDepth",           4,    1,    10) \
+	X(null_base_reduction,    "NullBaseReduction",      4,    1,    8) \
+	X(null_eval_reduction,    "NullEvalReduction",      3,    0,    6) \
+	X(lmr_min_depth,          "LmrMinDepth",            3,    1,    10) \
+	X(lmr_pv_move_num,        "LmrPvMoveNum",           3,    1,    20) \
+	X(lmr_non_pv_move_num,    "LmrNonPvMoveNum",        1,    1,    20) \
+	X(lmr_base_pv,            "LmrBasePv",              25,   -100, 200) \
+	X(lmr_div_pv,             "LmrDivPv",               300,  100,  600) \
+	X(lmr_base_non_pv,        "LmrBaseNonPv",           75,   -100, 200) \
+	X(lmr_div_non_pv,         "LmrDivNonPv",            225,  100,  600) \
+	X(lmr_hist_div,           "LmrHistDiv",             5000, 1000, 20000) \
+	X(razor_depth,            "RazorDepth",             3,    0,    6) \
+	X(razor_margin,           "RazorMargin",            250,  50,   800) \
+	X(lmp_depth,              "LmpDepth",               6,    0,    12) \
+	X(lmp_base,               "LmpBase",                3,    0,    12) \
+	X(probcut_depth,          "ProbCutDepth",           5,    3,    12) \
+	X(probcut_margin,         "ProbCutMargin",          200,  50,   500) \
+	X(singular_depth,         "SingularDepth",          8,    4,    16) \
+	X(singular_margin,        "SingularMargin",         2,    0,    10) \
+	X(history_limit,          "HistoryLimit",           16384, 1000, 32000) \
+	X(tm_hard_ratio,          "TmHardRatio",            5,    1,    10) \
+	X(tm_min_depth,           "TmMinDepth",             4,    1,    12) \
+	X(tm_stable_step,         "TmStableStep",           5,    0,    10) \
+	X(tm_score_drop_max,      "TmScoreDropMax",         50,   0,    150) \
+	X(tm_node_base,           "TmNodeBase",             150,  100,  250) \
+	X(aspiration_depth,       "AspirationDepth",        5,    2,    16) \
+	X(aspiration_delta_1,     "AspirationDelta1",       10,   1,    100) \
+	X(aspiration_delta_2,     "AspirationDelta2",       25,   1,    200) \
+	X(aspiration_delta_3,     "AspirationDelta3",       50,   1,    400) \
+	X(aspiration_delta_4,     "AspirationDelta4",       100,  1,    800) \
+	X(aspiration_delta_5,     "AspirationDelta5",       200,  1,    1600)
+
+#ifdef TUNE_BUILD
+
+struct SearchTunable
+{
+	char name[50];
+	int* val;
+	int min_val;
+	int max_val;
+	int default_val;
+};
+
+#define X(var, name, val, lo, hi) extern int var;
+SEARCH_TUNABLES
+#undef X
+
+#define X(var, name, val, lo, hi) + 1
+enum { NUM_SEARCH_TUNABLES = 0 SEARCH_TUNABLES };
+#undef X
+
+extern struct SearchTunable search_tunables[NUM_SEARCH_TUNABLES];
+
+#else
+
+#define X(var, name, val, lo, hi) var = val,
+enum SearchTunables { SEARCH_TUNABLES };
+#undef X
+
+#endif
+
+#endif
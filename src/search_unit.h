@@ -1,5 +1,5 @@
-#ifndef ENGINE_H
-#define ENGINE_H
+#ifndef SEARCH_UNIT_H
+#define SEARCH_UNIT_H
 
 /*
  * WyldChess, a free UCI/Xboard compatible chess engine
@@ -24,10 +24,13 @@
 #include "position.h"
 #include "misc.h"
 #include "options.h"
+#include "search_tune.h"
 
 enum Protocols {
 	XBOARD,
-	UCI
+	UCI,
+	LIBRARY,  // Iterations are reported through the info callback of the engine
+	NO_PROTOCOL
 };
 
 enum States {
@@ -46,6 +49,9 @@ struct SearchStack
 {
 	int node_type;
 	int forward_prune;
+	int static_eval;  // INVALID when in check
+	u32 excluded_move;     // Move left out by a singular extension search, 0 for none
+	int (*cont_hist)[64];  // Continuation history of the move made at this ply, NULL after a null move
 	u32 ply;
 	u32 killers[2];
 	int order_arr[MAX_MOVES_PER_POS];
@@ -54,10 +60,18 @@ struct SearchStack
 	u32 pv[MAX_PLY];
 };
 
+#define CORR_HIST_SIZE   (16384)
+#define CORR_HIST_GRAIN  (256)
+#define CORR_HIST_MAX    (CORR_HIST_GRAIN * 64)
+
+// Pieces are indexed as piece type - PAWN + 6 * color in the histories
 struct SearchLocals
 {
 	u64 tb_hits;
-	int history[8][64];
+	int history[2][64][64];            // Butterfly history, [color][from][to]
+	int cap_history[12][64][8];        // [piece][to][captured piece type]
+	int (*cont_history)[64][12][64];   // [previous piece][previous to][piece][to], see alloc_search_locals
+	int corr_history[2][CORR_HIST_SIZE];  // Static eval error by [color][pawn key], in 1/CORR_HIST_GRAIN cp
 	u32 counter_move_table[64][64];
 };
 
@@ -65,9 +79,11 @@ struct SearchUnit
 {
 	struct Position pos;
 	struct SearchLocals sl;
+	struct Controller* ctlr;
 	pthread_mutex_t mutex;
 	pthread_cond_t sleep_cv;
 	u32 max_searched_ply;
+	int id;
 	int type;
 	int protocol;
 	int side;
@@ -75,12 +91,22 @@ struct SearchUnit
 	int counter;
 	u32 ponder_allowed;
 	u32 ponder_move;
+	u64 best_move_nodes;  // Nodes spent on the best root move by the last root search
+	u64 currmove_time;    // Search time of the last currmove line
 	u32 limited_moves_num;
 	u32 limited_moves[MAX_MOVES_PER_POS];
 	int volatile target_state;
 	int volatile curr_state;
 };
 
+// A root line of a MultiPV search
+struct PVLine
+{
+	int val;
+	int pv_depth;
+	u32 pv[MAX_PLY];
+};
+
 struct SearchParams
 {
 	struct SearchUnit* su;
@@ -91,37 +117,102 @@ struct SearchParams
 	int result;
 };
 
+#define LATENCY_SAMPLES   (32)
+#define CURRMOVE_INTERVAL (100)  // Milliseconds between currmove lines
+
+// Turnaround of the engine itself from reading position and go to writing bestmove, search time excluded
+struct Latency
+{
+	u64 samples[LATENCY_SAMPLES];
+	u32 num;
+	u32 next;
+	u64 estimate;  // 90th percentile of the samples in ms, added to MoveOverhead
+	u64 reported;
+};
+
+struct Engine;
+
 struct Controller
 {
 	volatile int is_stopped;
+	volatile int abort_search;
 	volatile int analyzing;
 	volatile int time_dependent;
 	u32 depth;
+	u64 node_limit;  // Soft limit checked after each iteration of search_silent, 0 for none
+	u64 max_nodes;   // Hard limit of go nodes checked along with the clock, 0 for none
+	u32 mate_moves;  // go mate stops once a mate in this many moves is found, 0 for none
 	u32 moves_left;
 	u32 moves_per_session;
 	u64 increment;
 	u64 time_left;
 	u64 search_start_time;
-	u64 search_end_time;
+	u64 search_end_time;  // Hard limit checked during the search
+	u64 soft_time;        // Milliseconds aimed for, rescaled after each iteration by begin_search, 0 for none
+	u64 input_time;       // When the commands starting the search were read
+	struct Latency latency;
 	u64 nodes_searched[MAX_THREADS];
+	u32 multipv_excluded_num;
+	u32 multipv_excluded[MAX_MULTIPV];  // Root moves of the lines already found in this iteration
+	struct TT* tt;
+	struct PT* pt;
+	struct Engine* engine;  // Owner of the threads and options of begin_search, NULL for search_silent only
 };
 
-extern struct Controller controller;
+struct GensfenParams
+{
+	u32 games;
+	u32 depth;
+	u64 nodes;         // Soft node limit checked after each iteration, 0 for none
+	u32 random_plies;  // Random moves played from the start position before searching
+	int eval_limit;    // Games are adjudicated once the score reaches this
+	u64 seed;
+	int threads;       // Games played in parallel
+};
 
-extern pthread_t search_threads[MAX_THREADS];
-extern struct SearchUnit search_units[MAX_THREADS];
-extern struct SearchStack search_stacks[MAX_THREADS][MAX_PLY];
-extern struct SearchParams search_params[MAX_THREADS];
+struct MatchParams
+{
+	u32 games;
+	u32 depth;
+	u64 nodes;         // Soft node limit per move checked after each iteration, 0 for none
+	u64 movetime;      // Milliseconds per move, 0 for none
+	u32 random_plies;  // Random moves played from the start position, shared by each pair of games
+	int eval_limit;    // Games are adjudicated once the score stays beyond this
+	int sprt;          // Stop as soon as the SPRT of elo0 against elo1 concludes
+	int elo0;
+	int elo1;
+	u64 seed;
+	int threads;       // Games played in parallel
+};
 
+// Caps on the limits of each request of the analysis server, 0 for none
+struct ServeParams
+{
+	u64 max_nodes;
+	u64 max_time;  // Milliseconds
+};
+
+extern void init_reductions();
+extern int alloc_search_locals(struct SearchLocals* const sl);
+extern void destroy_search_locals(struct SearchLocals* const sl);
 extern void init_search(struct SearchLocals* const sl);
+extern int search(struct SearchUnit* const su, struct SearchStack* const ss, int alpha, int beta, int depth);
 extern int begin_search(struct SearchUnit* const su);
-extern void xboard_loop();
-extern void uci_loop();
+extern u32 search_silent(struct SearchUnit* const su, struct SearchStack* const ss, int* const score);
+extern void gensfen(char const * const out_path, struct GensfenParams const * const params);
+extern void bench(struct Engine* const engine, u32 depth);
+extern void see_bench();
+extern void match(char const * const persona_a, char const * const persona_b, struct MatchParams const * const params);
+extern void serve(struct Engine* const engine, struct ServeParams const * const params);
+extern void xboard_loop(struct Engine* const engine);
+extern void uci_loop(struct Engine* const engine);
 
-static inline void init_search_unit(struct SearchUnit* const su)
+static inline void init_search_unit(struct SearchUnit* const su, struct Controller* const ctlr)
 {
 	pthread_mutex_init(&su->mutex, NULL);
 	pthread_cond_init(&su->sleep_cv, NULL);
+	su->ctlr = ctlr;
+	su->id = 0;
 	su->type = MAIN;
 	su->target_state = WAITING;
 	su->ponder_allowed = 1;
@@ -132,9 +223,12 @@ static inline void init_search_unit(struct SearchUnit* const su)
 	set_pos(&su->pos, INITIAL_POSITION);
 }
 
+// The copy keeps its own continuation history
 static inline void get_search_locals_copy(struct SearchLocals const * const sl, struct SearchLocals* const sl_copy)
 {
+	int (*cont_history)[64][12][64] = sl_copy->cont_history;
 	memcpy(sl_copy, sl, sizeof(struct SearchLocals));
+	sl_copy->cont_history = cont_history;
 }
 
 static inline void get_search_unit_copy(struct SearchUnit const * const su, struct SearchUnit* const copy_su)
@@ -145,6 +239,7 @@ static inline void get_search_unit_copy(struct SearchUnit const * const su, stru
 	pthread_cond_init(&copy_su->sleep_cv, NULL);
 	memcpy(copy_su->limited_moves, su->limited_moves, sizeof(u32) * su->limited_moves_num);
 	copy_su->limited_moves_num = su->limited_moves_num;
+	copy_su->ctlr              = su->ctlr;
 	copy_su->ponder_allowed    = su->ponder_allowed;
 	copy_su->ponder_move       = su->ponder_move;
 	copy_su->type              = su->type;
@@ -156,10 +251,10 @@ static inline void get_search_unit_copy(struct SearchUnit const * const su, stru
 	copy_su->game_over         = su->game_over;
 }
 
-static inline u64 total_nodes_searched()
+static inline u64 total_nodes_searched(struct Controller const * const ctlr)
 {
-	u64* thread_nodes = controller.nodes_searched;
-	static u64* end = controller.nodes_searched + MAX_THREADS;
+	u64 const* thread_nodes = ctlr->nodes_searched;
+	u64 const* end = ctlr->nodes_searched + MAX_THREADS;
 	u64 count = *thread_nodes;
 	for (++thread_nodes; thread_nodes < end; ++thread_nodes)
 		count += *thread_nodes;
@@ -186,20 +281,20 @@ static inline void transition(struct SearchUnit* const su, int target_state)
 	sync(su);
 }
 
-static inline void start_thinking(struct SearchUnit* const su)
-{
-	struct Controller* const ctlr = &controller;
-	ctlr->search_start_time = curr_time();
-	ctlr->time_left += (ctlr->moves_left - 1) * ctlr->increment;
-	ctlr->search_end_time = ctlr->search_start_time
-			     + (ctlr->time_left / ctlr->moves_left)
-			     -  spin_options[MOVE_OVERHEAD].curr_val;
-	transition(su, THINKING);
-	if (ctlr->moves_per_session) {
-		--ctlr->moves_left;
-		if (ctlr->moves_left < 1)
-			ctlr->moves_left = ctlr->moves_per_session;
+static inline void record_latency(struct Latency* const lat, u64 sample)
+{
+	lat->samples[lat->next] = sample;
+	lat->next = (lat->next + 1) % LATENCY_SAMPLES;
+	lat->num  = min(lat->num + 1, LATENCY_SAMPLES);
+
+	u64 sorted[LATENCY_SAMPLES];
+	u32 i, j;
+	for (i = 0; i != lat->num; ++i) {
+		for (j = i; j && sorted[j - 1] > lat->samples[i]; --j)
+			sorted[j] = sorted[j - 1];
+		sorted[j] = lat->samples[i];
 	}
+	lat->estimate = sorted[lat->num * 9 / 10];
 }
 
 #endif
@@ -0,0 +1,358 @@
+/*
+ * WyldChess, a free UCI/Xboard compatible chess engine
+ * Copyright (C) 2016-2017 Manik Charan
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "search.h"
+#include "engine.h"
+
+// Batch analysis over JSON lines on stdin, one request object per line:
+//   {"id": 7, "fen": "<fen>|startpos", "moves": "e2e4 e7e5", "depth": 20, "nodes": 1000000, "movetime": 500}
+// Only the FEN is required. Requests are searched by a pool of single threaded workers sharing the TT,
+// every result is written as one line tagged with the id of its request, in the order searches finish:
+//   {"id": 7, "bestmove": "g1f3", "cp": 31, "nodes": 1000000, "time": 402}
+// The node and time limits of a request are capped by the limits given to the serve command.
+
+#define SERVE_PT_MB       (1)
+#define SERVE_QUEUE_LEN   (256)
+#define MAX_ID_LEN        (64)
+
+struct Request
+{
+	char id[MAX_ID_LEN];  // The raw JSON value, echoed back
+	char fen[MAX_FEN_LEN];
+	char* moves;
+	u32 depth;
+	u64 nodes;
+	u64 movetime;
+};
+
+static struct Engine* server_engine;  // Gives the TT, the worker count and UCI_Chess960
+static struct ServeParams const* sp;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_not_empty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_not_full  = PTHREAD_COND_INITIALIZER;
+static struct Request queue[SERVE_QUEUE_LEN];
+static u32 queue_head;
+static u32 queue_len;
+static int input_done;
+
+static void push_request(struct Request const * const req)
+{
+	pthread_mutex_lock(&queue_mutex);
+	while (queue_len == SERVE_QUEUE_LEN)
+		pthread_cond_wait(&queue_not_full, &queue_mutex);
+	queue[(queue_head + queue_len++) % SERVE_QUEUE_LEN] = *req;
+	pthread_cond_signal(&queue_not_empty);
+	pthread_mutex_unlock(&queue_mutex);
+}
+
+// Returns 0 once the input has ended and every request was taken
+static int pop_request(struct Request* const req)
+{
+	pthread_mutex_lock(&queue_mutex);
+	while (!queue_len && !input_done)
+		pthread_cond_wait(&queue_not_empty, &queue_mutex);
+	int ok = queue_len != 0;
+	if (ok) {
+		*req       = queue[queue_head];
+		queue_head = (queue_head + 1) % SERVE_QUEUE_LEN;
+		--queue_len;
+		pthread_cond_signal(&queue_not_full);
+	}
+	pthread_mutex_unlock(&queue_mutex);
+	return ok;
+}
+
+static char const* skip_ws(char const* p)
+{
+	while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+		++p;
+	return p;
+}
+
+// Returns the end of the JSON value starting at p, NULL when it is malformed
+static char const* skip_value(char const* p)
+{
+	int depth = 0;
+	do {
+		p = skip_ws(p);
+		if (*p == '"') {
+			for (++p; *p != '"'; ++p) {
+				if (   !*p
+				    || (*p == '\\' && !*++p))
+					return NULL;
+			}
+			++p;
+		} else if (*p == '{' || *p == '[') {
+			++depth;
+			++p;
+		} else if (*p == '}' || *p == ']') {
+			if (!depth)
+				return NULL;
+			--depth;
+			++p;
+		} else if (*p == ',' || *p == ':') {
+			if (!depth)
+				return NULL;
+			++p;
+		} else {
+			char const* start = p;
+			while (*p && strchr("+-.0123456789eEtruefalsn", *p))
+				++p;
+			if (p == start)
+				return NULL;
+		}
+	} while (depth);
+	return p;
+}
+
+// Finds a member of the top level object and returns its value, NULL when it is missing or the line is malformed
+static char const* json_member(char const* p, char const* key, char const** const end)
+{
+	u32 len = strlen(key);
+	p = skip_ws(p);
+	if (*p++ != '{')
+		return NULL;
+	p = skip_ws(p);
+	if (*p == '}')
+		return NULL;
+	while (1) {
+		char const* name = skip_ws(p);
+		if (   *name != '"'
+		    || !(p = skip_value(name)))
+			return NULL;
+		int match = p - name - 2 == len && !strncmp(name + 1, key, len);
+		p = skip_ws(p);
+		if (*p++ != ':')
+			return NULL;
+		char const* val = skip_ws(p);
+		if (!(p = skip_value(val)))
+			return NULL;
+		if (match) {
+			*end = p;
+			return val;
+		}
+		p = skip_ws(p);
+		if (*p++ != ',')
+			return NULL;
+	}
+}
+
+// Copies a JSON string without its quotes, escapes are taken literally
+static int json_string(char const* val, char const* end, char* const out, u32 cap)
+{
+	if (*val != '"')
+		return 0;
+	u32 len = 0;
+	for (++val, --end; val < end; ++val) {
+		if (*val == '\\')
+			++val;
+		if (len + 1 == cap)
+			return 0;
+		out[len++] = *val;
+	}
+	out[len] = '\0';
+	return 1;
+}
+
+static int json_number(char const* val, u64* const out)
+{
+	if (*val < '0' || *val > '9')
+		return 0;
+	*out = strtoull(val, NULL, 10);
+	return 1;
+}
+
+// Fills a request from a line, returns an error message when that fails
+static char const* parse_request(char const * const line, struct Request* const req)
+{
+	char const* end;
+	char const* val;
+	u64 num;
+	memset(req, 0, sizeof(struct Request));
+	strcpy(req->id, "null");
+	if (   *skip_ws(line) != '{'
+	    || !skip_value(line))
+		return "malformed JSON";
+	if ((val = json_member(line, "id", &end))) {
+		if (   (*val != '"' && (*val < '0' || *val > '9'))
+		    || end - val >= MAX_ID_LEN)
+			return "id must be a short string or a number";
+		memcpy(req->id, val, end - val);
+		req->id[end - val] = '\0';
+	}
+	if (   !(val = json_member(line, "fen", &end))
+	    || !json_string(val, end, req->fen, MAX_FEN_LEN))
+		return "fen missing";
+	if ((val = json_member(line, "moves", &end))) {
+		req->moves = malloc(end - val + 1);
+		if (!json_string(val, end, req->moves, end - val + 1))
+			return "moves must be a string";
+	}
+	if ((val = json_member(line, "depth", &end))) {
+		if (!json_number(val, &num))
+			return "depth must be a number";
+		req->depth = num > MAX_PLY - 1 ? MAX_PLY - 1 : num;
+	}
+	if ((val = json_member(line, "nodes", &end))) {
+		if (!json_number(val, &req->nodes))
+			return "nodes must be a number";
+	}
+	if ((val = json_member(line, "movetime", &end))) {
+		if (!json_number(val, &req->movetime))
+			return "movetime must be a number";
+	}
+	return NULL;
+}
+
+static void send_error(char const * const id, char const * const error)
+{
+	out_printf("{\"id\": %s, \"error\": \"%s\"}\n", id, error);
+	out_flush();
+}
+
+static int setup_request(struct Position* const pos, struct Request* const req, char const** const error)
+{
+	init_pos(pos);
+	pos->is_frc = server_engine->is_frc;
+	if (!strcmp(req->fen, "startpos"))
+		set_pos(pos, INITIAL_POSITION);
+	else if ((*error = set_pos_checked(pos, req->fen)))
+		return 0;
+	return !(*error = play_moves(pos, req->moves));
+}
+
+// A limit of 0 is none
+static inline u64 cap_limit(u64 limit, u64 cap)
+{
+	return !cap || (limit && limit < cap) ? limit : cap;
+}
+
+static void run_request(struct SearchUnit* const su, struct SearchStack* const ss, struct Request* const req)
+{
+	struct Controller* const ctlr = su->ctlr;
+	char const* error = NULL;
+	if (!setup_request(&su->pos, req, &error)) {
+		send_error(req->id, error);
+		return;
+	}
+
+	// Requests without limits get the server's, the server's caps every request
+	ctlr->depth          = req->depth ? req->depth : MAX_PLY - 1;
+	ctlr->max_nodes      = cap_limit(req->nodes, sp->max_nodes);
+	u64 movetime         = cap_limit(req->movetime, sp->max_time);
+	ctlr->time_dependent = movetime > 0;
+	init_search(&su->sl);
+
+	int score = 0;
+	ctlr->search_start_time = curr_time();
+	ctlr->search_end_time   = ctlr->search_start_time + movetime;
+	u32 move  = search_silent(su, ss, &score);
+	u64 time  = curr_time() - ctlr->search_start_time;
+	char mstr[6] = "0000";
+	if (move)
+		move_str(&su->pos, move, mstr);
+	out_printf("{\"id\": %s, \"bestmove\": \"%s\", ", req->id, mstr);
+	// Checkmated or stalemated at the root
+	if (!move) {
+		set_checkers(&su->pos);
+		score = su->pos.state->checkers_bb ? -MATE : 0;
+	}
+	if (abs(score) < MAX_MATE_VAL)
+		out_printf("\"cp\": %d, ", score);
+	else
+		out_printf("\"mate\": %d, ", score < 0 ? (-score - MATE) / 2 : (-score + MATE + 1) / 2);
+	out_printf("\"nodes\": %llu, \"time\": %llu}\n", total_nodes_searched(ctlr), time);
+	out_flush();
+}
+
+static void* serve_worker(void* arg)
+{
+	(void) arg;
+	struct Controller* ctlr = calloc(1, sizeof(struct Controller));
+	struct SearchUnit* su   = calloc(1, sizeof(struct SearchUnit));
+	struct SearchStack* ss  = malloc(sizeof(struct SearchStack) * MAX_PLY);
+	struct PT local_pt      = { NULL, 0 };
+	pt_alloc_MB(&local_pt, SERVE_PT_MB);
+	ctlr->tt         = server_engine->ctlr.tt;
+	ctlr->pt         = &local_pt;
+	su->ctlr         = ctlr;
+	su->id           = 0;
+	su->type         = MAIN;
+	su->protocol     = NO_PROTOCOL;
+	su->target_state = THINKING;
+	alloc_search_locals(&su->sl);
+
+	struct Request req;
+	while (pop_request(&req)) {
+		run_request(su, ss, &req);
+		free(req.moves);
+	}
+
+	pt_destroy(&local_pt);
+	destroy_search_locals(&su->sl);
+	free(ss);
+	free(su);
+	free(ctlr);
+	return NULL;
+}
+
+// Reads requests until the end of the input or a {"quit": true} line, then finishes the queued ones
+void serve(struct Engine* const engine, struct ServeParams const * const params)
+{
+	server_engine = engine;
+	sp            = params;
+	queue_head    = 0;
+	queue_len     = 0;
+	input_done    = 0;
+
+	int num_threads = engine->options[THREADS];
+	pthread_t threads[MAX_THREADS];
+	int i;
+	for (i = 0; i != num_threads; ++i)
+		pthread_create(threads + i, NULL, serve_worker, NULL);
+	out_printf("{\"ready\": true, \"workers\": %d}\n", num_threads);
+	out_flush();
+
+	char* line = NULL;
+	u32 cap = 0;
+	char const* error;
+	char const* val;
+	char const* end;
+	struct Request req;
+	while (read_line(&line, &cap, stdin)) {
+		if (!*skip_ws(line))
+			continue;
+		if (   (val = json_member(line, "quit", &end))
+		    && *val == 't')
+			break;
+		if ((error = parse_request(line, &req))) {
+			send_error(req.id, error);
+			free(req.moves);
+			continue;
+		}
+		push_request(&req);
+	}
+	free(line);
+
+	pthread_mutex_lock(&queue_mutex);
+	input_done = 1;
+	pthread_cond_broadcast(&queue_not_empty);
+	pthread_mutex_unlock(&queue_mutex);
+	for (i = 0; i != num_threads; ++i)
+		pthread_join(threads[i], NULL);
+}
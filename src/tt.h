@@ -46,8 +46,6 @@ struct TT
 	u32 size;
 };
 
-extern struct TT tt;
-
 static inline int val_to_tt(int val, int ply)
 {
 	if (val >= MAX_MATE_VAL)
@@ -0,0 +1,439 @@
+/*
+ * WyldChess, a free UCI/Xboard compatible chess engine
+ * Copyright (C) 2016-2017 Manik Charan
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <sys/stat.h>
+#include "position.h"
+
+#define MAX_ITERATIONS  (5000)
+#define REPORT_INTERVAL (100)
+#define LEARNING_RATE   (5.0)
+#define TRACE_MAGIC     (0x52544357) // "WCTR"
+
+// Non-zero coefficient of a term in a traced position
+struct TraceCoeff
+{
+	unsigned short index;
+	short mg;
+	short eg;
+};
+
+// Labelled position reduced to its evaluation trace
+struct TraceEntry
+{
+	int eval[2];  // Mg and Eg eval not covered by the traced terms
+	u32 first;    // Index of the first coefficient in the coefficient pool
+	unsigned short num_coeffs;
+	short phase;
+	unsigned char scale;
+	unsigned char clamp;
+	unsigned char result; // 0, 1 or 2 half-points for white
+};
+
+// The traces are only valid for the data file and the evaluation they were built from
+struct TraceFileHeader
+{
+	u64 data_size;
+	u64 data_mtime;
+	u32 magic;
+	u32 num_terms;
+	u32 entry_size;
+	u32 eval_version;
+	u32 params_hash;
+	u32 num_entries;
+	u32 num_coeffs;
+	u32 padding;
+};
+
+struct TuneWorker
+{
+	struct TraceEntry const* begin;
+	struct TraceEntry const* end;
+	double K;
+	double error;
+	double grad[NUM_TERMS][2];
+};
+
+static struct TraceEntry* entries;
+static struct TraceCoeff* coeffs;
+static u32 num_entries;
+static u32 num_coeffs;
+static double values[NUM_TERMS][2];
+
+static int parse_result(char const * const line)
+{
+	if (strstr(line, "1/2-1/2") || strstr(line, "[0.5]"))
+		return 1;
+	if (strstr(line, "1-0") || strstr(line, "[1.0]") || strstr(line, "[1]"))
+		return 2;
+	if (strstr(line, "0-1") || strstr(line, "[0.0]") || strstr(line, "[0]"))
+		return 0;
+	return -1;
+}
+
+static inline int term_val(int i, int part)
+{
+	return i >= TAPERED_END ? *eval_term_ptr(&eval_params, eval_terms + i)
+	     : part == 0        ? mg_val(*eval_term_ptr(&eval_params, eval_terms + i))
+	     : eg_val(*eval_term_ptr(&eval_params, eval_terms + i));
+}
+
+// FNV-1a of the evaluation parameters, the untraced remainder of each entry depends on all of them
+static u32 params_hash()
+{
+	unsigned char const* byte = (unsigned char const*) &eval_params;
+	u32 hash = 2166136261u;
+	for (size_t i = 0; i != sizeof(eval_params); ++i)
+		hash = (hash ^ byte[i]) * 16777619u;
+	return hash;
+}
+
+// Header the trace file of the data file must have, returns 1 when the data file cannot be read
+static int expected_header(struct TraceFileHeader* const header, char const * const data_path)
+{
+	struct stat st;
+	if (stat(data_path, &st))
+		return 1;
+	memset(header, 0, sizeof(struct TraceFileHeader));
+	header->data_size    = st.st_size;
+	header->data_mtime   = st.st_mtime;
+	header->magic        = TRACE_MAGIC;
+	header->num_terms    = NUM_TERMS;
+	header->entry_size   = sizeof(struct TraceEntry);
+	header->eval_version = EVAL_VERSION;
+	header->params_hash  = params_hash();
+	return 0;
+}
+
+static int build_traces(char const * const path)
+{
+	FILE* file = fopen(path, "r");
+	if (!file)
+		return 1;
+
+	struct Position* pos = malloc(sizeof(struct Position));
+	struct EvalTrace trace;
+	struct TraceEntry* entry;
+	u32 capacity = 1 << 16, coeff_capacity = 1 << 20;
+	char line[256];
+	int result, i;
+	entries     = malloc(sizeof(struct TraceEntry) * capacity);
+	coeffs      = malloc(sizeof(struct TraceCoeff) * coeff_capacity);
+	num_entries = 0;
+	num_coeffs  = 0;
+	while (fgets(line, sizeof(line), file)) {
+		if ((result = parse_result(line)) == -1)
+			continue;
+		if (num_entries == capacity) {
+			capacity *= 2;
+			entries   = realloc(entries, sizeof(struct TraceEntry) * capacity);
+		}
+		if (num_coeffs + NUM_TERMS > coeff_capacity) {
+			coeff_capacity *= 2;
+			coeffs          = realloc(coeffs, sizeof(struct TraceCoeff) * coeff_capacity);
+		}
+		init_pos(pos);
+		set_pos(pos, line);
+		evaluate_trace(pos, &trace);
+
+		entry             = entries + num_entries;
+		entry->eval[0]    = trace.eval[0];
+		entry->eval[1]    = trace.eval[1];
+		entry->first      = num_coeffs;
+		entry->num_coeffs = 0;
+		entry->phase      = trace.phase;
+		entry->scale      = trace.scale;
+		entry->clamp      = trace.clamp;
+		entry->result     = result;
+		for (i = 0; i != NUM_TERMS; ++i) {
+			if (!trace.coeffs[i][0] && !trace.coeffs[i][1])
+				continue;
+			// Keep only what the terms do not explain as the constant part
+			entry->eval[0] -= trace.coeffs[i][0] * term_val(i, 0);
+			entry->eval[1] -= trace.coeffs[i][1] * term_val(i, 1);
+			coeffs[num_coeffs++] = (struct TraceCoeff) { i, trace.coeffs[i][0], trace.coeffs[i][1] };
+			++entry->num_coeffs;
+		}
+		++num_entries;
+	}
+	fclose(file);
+	free(pos);
+	return 0;
+}
+
+static int save_traces(char const * const path, struct TraceFileHeader header)
+{
+	FILE* file = fopen(path, "wb");
+	if (!file)
+		return 1;
+	header.num_entries = num_entries;
+	header.num_coeffs  = num_coeffs;
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(entries, sizeof(struct TraceEntry), num_entries, file);
+	fwrite(coeffs, sizeof(struct TraceCoeff), num_coeffs, file);
+	fclose(file);
+	return 0;
+}
+
+// Like the other loaders returns 0 on success and 1 otherwise, a stale trace file is not loaded
+static int load_traces(char const * const path, struct TraceFileHeader const * const expected)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return 1;
+	struct TraceFileHeader header;
+	if (   fread(&header, sizeof(header), 1, file) != 1
+	    || header.data_size    != expected->data_size
+	    || header.data_mtime   != expected->data_mtime
+	    || header.magic        != expected->magic
+	    || header.num_terms    != expected->num_terms
+	    || header.entry_size   != expected->entry_size
+	    || header.eval_version != expected->eval_version
+	    || header.params_hash  != expected->params_hash) {
+		fclose(file);
+		return 1;
+	}
+	num_entries = header.num_entries;
+	num_coeffs  = header.num_coeffs;
+	entries     = malloc(sizeof(struct TraceEntry) * max(num_entries, 1));
+	coeffs      = malloc(sizeof(struct TraceCoeff) * max(num_coeffs, 1));
+	if (   fread(entries, sizeof(struct TraceEntry), num_entries, file) != num_entries
+	    || fread(coeffs, sizeof(struct TraceCoeff), num_coeffs, file) != num_coeffs) {
+		free(entries);
+		free(coeffs);
+		fclose(file);
+		return 1;
+	}
+	fclose(file);
+	return 0;
+}
+
+static inline double sigmoid(double K, double eval)
+{
+	return 1.0 / (1.0 + pow(10.0, -K * eval / 400.0));
+}
+
+// Scaled linear eval from white's side, the unclamped value is left in raw
+static inline double linear_eval(struct TraceEntry const * const entry, double* const raw)
+{
+	if (!entry->scale)
+		return *raw = 0.0;
+	double mg = entry->eval[0], eg = entry->eval[1];
+	struct TraceCoeff const* coeff = coeffs + entry->first;
+	struct TraceCoeff const* end   = coeff + entry->num_coeffs;
+	for (; coeff != end; ++coeff) {
+		mg += coeff->mg * values[coeff->index][0];
+		eg += coeff->eg * values[coeff->index][1];
+	}
+	double eval = (mg * entry->phase + eg * (MAX_PHASE - entry->phase)) / MAX_PHASE / entry->scale;
+	*raw = eval;
+	if (entry->clamp & CLAMP_WHITE)
+		eval = eval < 0.0 ? eval : 0.0;
+	if (entry->clamp & CLAMP_BLACK)
+		eval = eval > 0.0 ? eval : 0.0;
+	return eval;
+}
+
+static void* error_worker(void* arg)
+{
+	struct TuneWorker* worker = (struct TuneWorker*) arg;
+	struct TraceEntry const* entry;
+	double error = 0.0, diff, raw;
+	for (entry = worker->begin; entry != worker->end; ++entry) {
+		diff   = entry->result / 2.0 - sigmoid(worker->K, linear_eval(entry, &raw));
+		error += diff * diff;
+	}
+	worker->error = error;
+	return NULL;
+}
+
+static void* gradient_worker(void* arg)
+{
+	struct TuneWorker* worker = (struct TuneWorker*) arg;
+	struct TraceEntry const* entry;
+	struct TraceCoeff const* coeff;
+	struct TraceCoeff const* end;
+	double eval, raw, s, d, mg_wt, eg_wt;
+	memset(worker->grad, 0, sizeof(worker->grad));
+	for (entry = worker->begin; entry != worker->end; ++entry) {
+		eval = linear_eval(entry, &raw);
+		// A clamped eval does not move with the terms
+		if (!entry->scale || eval != raw)
+			continue;
+		s     = sigmoid(worker->K, eval);
+		d     = (s - entry->result / 2.0) * s * (1.0 - s);
+		mg_wt = d * entry->phase / MAX_PHASE / entry->scale;
+		eg_wt = d * (MAX_PHASE - entry->phase) / MAX_PHASE / entry->scale;
+		coeff = coeffs + entry->first;
+		end   = coeff + entry->num_coeffs;
+		for (; coeff != end; ++coeff) {
+			worker->grad[coeff->index][0] += coeff->mg * mg_wt;
+			worker->grad[coeff->index][1] += coeff->eg * eg_wt;
+		}
+	}
+	return NULL;
+}
+
+static void run_workers(struct TuneWorker* const workers, int num_workers, void* (*func)(void*))
+{
+	pthread_t threads[MAX_THREADS];
+	int i;
+	for (i = 0; i != num_workers; ++i)
+		pthread_create(threads + i, NULL, func, workers + i);
+	for (i = 0; i != num_workers; ++i)
+		pthread_join(threads[i], NULL);
+}
+
+static double total_error(struct TuneWorker* const workers, int num_workers, double K)
+{
+	double error = 0.0;
+	int i;
+	for (i = 0; i != num_workers; ++i)
+		workers[i].K = K;
+	run_workers(workers, num_workers, error_worker);
+	for (i = 0; i != num_workers; ++i)
+		error += workers[i].error;
+	return error / num_entries;
+}
+
+static double find_K(struct TuneWorker* const workers, int num_workers)
+{
+	double lo = 0.0, hi = 3.0, m1, m2;
+	int i;
+	for (i = 0; i != 30; ++i) {
+		m1 = lo + (hi - lo) / 3.0;
+		m2 = hi - (hi - lo) / 3.0;
+		if (total_error(workers, num_workers, m1) < total_error(workers, num_workers, m2))
+			hi = m2;
+		else
+			lo = m1;
+	}
+	return (lo + hi) / 2.0;
+}
+
+static void store_values()
+{
+	for (int i = 0; i != NUM_TERMS; ++i) {
+		if (i < TAPERED_END) {
+			set_mg_val(*eval_term_ptr(&eval_params, eval_terms + i), (int) lround(values[i][0]));
+			set_eg_val(*eval_term_ptr(&eval_params, eval_terms + i), (int) lround(values[i][1]));
+		} else {
+			*eval_term_ptr(&eval_params, eval_terms + i) = (int) lround(values[i][0]);
+		}
+	}
+}
+
+static void write_persona(char const * const path)
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+		return;
+	for (int i = 0; i != NUM_TERMS; ++i) {
+		if (i < TAPERED_END) {
+			fprintf(file, "%sMg = %d\n", eval_terms[i].name, mg_val(*eval_term_ptr(&eval_params, eval_terms + i)));
+			fprintf(file, "%sEg = %d\n", eval_terms[i].name, eg_val(*eval_term_ptr(&eval_params, eval_terms + i)));
+		} else {
+			fprintf(file, "%s = %d\n", eval_terms[i].name, *eval_term_ptr(&eval_params, eval_terms + i));
+		}
+	}
+	fclose(file);
+}
+
+void tune(char const * const data_path, char const * const persona_path, int num_threads)
+{
+	u64 start = curr_time();
+	char trace_path[1024];
+	struct TraceFileHeader header;
+	snprintf(trace_path, sizeof(trace_path), "%s.trace", data_path);
+	if (expected_header(&header, data_path)) {
+		fprintf(stdout, "info string Unable to open %s\n", data_path);
+		return;
+	}
+	if (!load_traces(trace_path, &header)) {
+		fprintf(stdout, "info string Loaded traces from %s\n", trace_path);
+	} else if (!build_traces(data_path)) {
+		if (num_entries && save_traces(trace_path, header))
+			fprintf(stdout, "info string Unable to write %s\n", trace_path);
+	} else {
+		fprintf(stdout, "info string Unable to open %s\n", data_path);
+		return;
+	}
+	if (!num_entries) {
+		fprintf(stdout, "info string No labelled positions in %s\n", data_path);
+		free(entries);
+		free(coeffs);
+		return;
+	}
+	fprintf(stdout, "info string Traced %u positions, %u coefficients in %llu ms\n",
+		num_entries, num_coeffs, curr_time() - start);
+
+	int num_workers = min(num_threads, num_entries);
+	struct TuneWorker* workers = malloc(sizeof(struct TuneWorker) * num_workers);
+	u32 per_worker = num_entries / num_workers;
+	int i, part;
+	for (i = 0; i != num_workers; ++i) {
+		workers[i].begin = entries + i * per_worker;
+		workers[i].end   = i == num_workers - 1 ? entries + num_entries : workers[i].begin + per_worker;
+	}
+
+	for (i = 0; i != NUM_TERMS; ++i) {
+		values[i][0] = term_val(i, 0);
+		values[i][1] = term_val(i, 1);
+	}
+
+	double K = find_K(workers, num_workers);
+	fprintf(stdout, "info string K %lf error %.8lf\n", K, total_error(workers, num_workers, K));
+
+	// Adagrad on the full batch, terms outside the linear trace (king attack weights) stay fixed
+	double grad[NUM_TERMS][2];
+	double grad_sq_sum[NUM_TERMS][2];
+	memset(grad_sq_sum, 0, sizeof(grad_sq_sum));
+	for (int iter = 1; iter <= MAX_ITERATIONS; ++iter) {
+		run_workers(workers, num_workers, gradient_worker);
+		memset(grad, 0, sizeof(grad));
+		for (i = 0; i != num_workers; ++i)
+			for (int t = 0; t != NUM_TERMS; ++t)
+				for (part = 0; part != 2; ++part)
+					grad[t][part] += workers[i].grad[t][part];
+
+		for (i = 0; i != NUM_TERMS; ++i) {
+			// Non-tapered terms apply the same value to both phases
+			if (i >= TAPERED_END) {
+				grad[i][0] += grad[i][1];
+				grad[i][1]  = grad[i][0];
+			}
+			for (part = 0; part != 2; ++part) {
+				grad_sq_sum[i][part] += grad[i][part] * grad[i][part];
+				if (grad_sq_sum[i][part] > 0.0)
+					values[i][part] -= LEARNING_RATE * grad[i][part] / sqrt(grad_sq_sum[i][part]);
+			}
+		}
+
+		if (!(iter % REPORT_INTERVAL) || iter == MAX_ITERATIONS) {
+			store_values();
+			write_persona(persona_path);
+			fprintf(stdout, "info string iteration %d error %.8lf time %llu\n",
+				iter, total_error(workers, num_workers, K), curr_time() - start);
+		}
+	}
+
+	free(workers);
+	free(entries);
+	free(coeffs);
+	fprintf(stdout, "info string Tuned persona written to %s\n", persona_path);
+}
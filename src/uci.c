@@ -16,17 +16,18 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <time.h>
 #include "syzygy/tbprobe.h"
 #include "defs.h"
 #include "search_unit.h"
-#include "tt.h"
-#include "options.h"
+#include "engine.h"
 #include "search.h"
+#include "packpos.h"
 
-static inline void print_spin_option(struct SpinOption* option)
+static inline void print_spin_option(struct SpinOption const* option)
 {
 	fprintf(stdout, "option name %s type spin default %d min %d max %d\n",
-		option->name, option->curr_val, option->min_val, option->max_val);
+		option->name, option->default_val, option->min_val, option->max_val);
 }
 
 static inline void print_eval_term_spin_option(struct EvalTerm* term, int num)
@@ -39,13 +40,13 @@ static inline void print_eval_term_spin_option(struct EvalTerm* term, int num)
 		str[len+1] = 'g';
 		str[len+2] = '\0';
 		fprintf(stdout, "option name %s type spin default %d min %d max %d\n",
-			str, mg_val(*term->ptr), -10000, 10000);
+			str, mg_val(*eval_term_ptr(&eval_params, term)), -10000, 10000);
 		str[len] = 'E';
 		fprintf(stdout, "option name %s type spin default %d min %d max %d\n",
-			str, eg_val(*term->ptr), -10000, 10000);
+			str, eg_val(*eval_term_ptr(&eval_params, term)), -10000, 10000);
 	} else {
 		fprintf(stdout, "option name %s type spin default %d min %d max %d\n",
-			term->name, *term->ptr, -10000, 10000);
+			term->name, *eval_term_ptr(&eval_params, term), -10000, 10000);
 	}
 }
 
@@ -59,8 +60,8 @@ static inline void print_options_uci()
 	fprintf(stdout, "option name PersonaPath type string default <empty>\n");
 	fprintf(stdout, "option name Hash type spin default 128 min 1 max 1048576\n");
 
-	struct SpinOption* curr = spin_options;
-	struct SpinOption* end  = spin_options + arr_len(spin_options);
+	struct SpinOption const* curr = spin_options;
+	struct SpinOption const* end  = spin_options + arr_len(spin_options);
 	for (; curr != end; ++curr)
 		print_spin_option(curr);
 
@@ -69,13 +70,39 @@ static inline void print_options_uci()
 	for (; curr_et != end_et; ++curr_et)
 		print_eval_term_spin_option(curr_et, curr_et - eval_terms);
 
+#ifdef TUNE_BUILD
+	struct SearchTunable* curr_st = search_tunables;
+	struct SearchTunable* end_st  = search_tunables + NUM_SEARCH_TUNABLES;
+	for (; curr_st != end_st; ++curr_st)
+		fprintf(stdout, "option name %s type spin default %d min %d max %d\n",
+			curr_st->name, curr_st->default_val, curr_st->min_val, curr_st->max_val);
+#endif
+
 	fprintf(stdout, "uciok\n");
 }
 
+// Returns where the new moves start when cmd extends the previous position command, NULL otherwise
+static char* position_suffix(char* cmd, char const * const prev)
+{
+	u32 len = strlen(prev);
+	if (   !len
+	    ||  strncmp(cmd, prev, len))
+		return NULL;
+	cmd += len;
+	if (!*cmd)
+		return cmd;
+	if (*cmd != ' ')
+		return NULL;
+	if (strstr(prev, " moves"))
+		return cmd;
+	return !strncmp(cmd, " moves", 6) ? cmd + 1 : NULL;
+}
+
 void* su_loop_uci(void* args)
 {
 	char mstr[6];
 	u32 move;
+	u64 stop_time;
 	struct SearchUnit* su = (struct SearchUnit*) args;
 	while (1) {
 		switch(su->target_state) {
@@ -90,13 +117,17 @@ void* su_loop_uci(void* args)
 		case THINKING:
 			su->curr_state = THINKING;
 			move = begin_search(su);
-			move_str(move, mstr);
-			fprintf(stdout, "bestmove %s", mstr);
+			stop_time = curr_time();
+			move_str(&su->pos, move, mstr);
+			out_printf("bestmove %s", mstr);
 			if (su->ponder_allowed) {
-				move_str(su->ponder_move, mstr);
-				fprintf(stdout, " ponder %s", mstr);
+				move_str(&su->pos, su->ponder_move, mstr);
+				out_printf(" ponder %s", mstr);
 			}
-			fprintf(stdout, "\n");
+			out_printf("\n");
+			out_flush();
+			record_latency(&su->ctlr->latency, su->ctlr->search_start_time - su->ctlr->input_time
+							   + curr_time() - stop_time);
 			su->target_state = WAITING;
 			break;
 
@@ -107,63 +138,82 @@ void* su_loop_uci(void* args)
 	}
 }
 
-void uci_loop()
+void uci_loop(struct Engine* const engine)
 {
-	static int const max_len = 4096;
-	char input[max_len];
+	char* input = NULL;
 	char* ptr;
 	char* end;
-	u32   move;
+	u32   move, input_cap = 0;
+
+	// The last position command, a new one that extends it only applies the moves added since.
+	// It is cleared on an illegal move and whenever the way moves are read may have changed.
+	u32   pos_cmd_cap = 256;
+	char* pos_cmd     = calloc(pos_cmd_cap, 1);
 
 	print_options_uci();
 
-	struct SearchUnit* su = search_units;
-	init_search_unit(su);
+	struct SearchUnit* su   = engine->units[0];
+	struct Controller* ctlr = &engine->ctlr;
 	struct Position* pos    = &su->pos;
-	struct Controller* ctlr = &controller;
 	su->protocol = UCI;
-	pthread_t* search_thread = search_threads;
+	pthread_t* search_thread = engine->threads;
 	pthread_create(search_thread, NULL, su_loop_uci, (void*) su);
 	pthread_detach(*search_thread);
 
+	// A position command read right before go counts towards the latency of the search
+	u64 read_time, position_time = 0;
+	int after_position, last_position = 0, eof;
 	while (1) {
-		fgets(input, max_len, stdin);
-		input[strlen(input)-1] = '\0';
+		eof            = !read_line(&input, &input_cap, stdin);
+		read_time      = curr_time();
+		after_position = last_position;
+		last_position  = 0;
 		if (!strncmp(input, "isready", 7)) {
 
 			fprintf(stdout, "readyok\n");
 
 		} else if (!strncmp(input, "ucinewgame", 10)) {
 
-			init_search(&su->sl);
-			tt_clear(&tt);
+			wc_new_game(engine);
+			pos_cmd[0] = '\0';
 
 		} else if (!strncmp(input, "position", 8)) {
 
 			transition(su, WAITING);
-			ptr = input + 9;
-			init_pos(pos);
-			if (!strncmp(ptr, "startpos", 8)) {
-				ptr += 9;
-				set_pos(pos, INITIAL_POSITION);
-			} else if (!strncmp(ptr, "fen", 3)) {
-				ptr += 4;
-				ptr += set_pos(pos, ptr);
-			}
-			if (  *(ptr - 1) != '\0'
-			    && !strncmp(ptr, "moves", 5)) {
-				while ((ptr = strstr(ptr, " "))) {
-					++ptr;
-					move = parse_move(pos, ptr);
-					if (!legal_move(pos, move)) {
-						char mstr[6];
-						move_str(move, mstr);
-						fprintf(stdout, "Illegal move: %s\n", mstr);
-						break;
-					}
-					do_move(pos, move);
+			last_position = 1;
+			position_time = read_time;
+			ptr = input + min(strlen(input), 9);
+			char* cmd = ptr;
+			char const* error = NULL;
+			int len = strlen(cmd);
+			if ((end = position_suffix(cmd, pos_cmd))) {
+				while (*end == ' ')
+					++end;
+				error = play_moves(pos, strncmp(end, "moves", 5) ? end : end + 5);
+			} else {
+				init_pos(pos);
+				pos->is_frc = engine->is_frc;
+				if (!strncmp(ptr, "startpos", 8)) {
+					ptr += 9;
+					set_pos(pos, INITIAL_POSITION);
+				} else if (!strncmp(ptr, "fen", 3)) {
+					ptr += 4;
+					ptr += set_pos(pos, ptr);
 				}
+				if (  *(ptr - 1) != '\0'
+				    && !strncmp(ptr, "moves", 5))
+					error = play_moves(pos, ptr + 5);
 			}
+			if (error)
+				fprintf(stdout, "info string Position command stopped: %s\n", error);
+			if (len + 1 > pos_cmd_cap) {
+				pos_cmd_cap = len + 1;
+				pos_cmd     = realloc(pos_cmd, pos_cmd_cap);
+			}
+			if (!error)
+				memcpy(pos_cmd, cmd, len + 1);
+			else
+				pos_cmd[0] = '\0';
 
 		} else if (!strncmp(input, "print", 5)) {
 
@@ -175,7 +225,7 @@ void uci_loop()
 			ctlr->analyzing = 0;
 			transition(su, WAITING);
 
-		} else if (!strncmp(input, "quit", 4)) {
+		} else if (eof || !strncmp(input, "quit", 4)) {
 
 			transition(su, WAITING);
 			transition(su, QUITTING);
@@ -183,11 +233,12 @@ void uci_loop()
 
 		} else if (!strncmp(input, "setoption name", 14)) {
 
+			pos_cmd[0] = '\0';
 			ptr = input + 15;
 			if (!strncmp(ptr, "Hash", 4)) {
 				ptr += 5;
 				if (!strncmp(ptr, "value", 5))
-					tt_alloc_MB(&tt, strtoul(ptr + 6, &end, 10));
+					tt_alloc_MB(ctlr->tt, strtoul(ptr + 6, &end, 10));
 			} else if (!strncmp(ptr, "SyzygyPath", 10)) {
 				ptr += 11;
 				if (!strncmp(ptr, "value", 5)) {
@@ -197,7 +248,7 @@ void uci_loop()
 			} else if (!strncmp(ptr, "PersonaPath", 11)) {
 				ptr += 12;
 				if (!strncmp(ptr, "value", 5)) {
-					parse_persona_file(ptr + 6);
+					parse_persona_file(&eval_params, ptr + 6);
 				}
 			} else if (!strncmp(ptr, "Ponder", 6)) {
 				ptr += 7;
@@ -214,15 +265,15 @@ void uci_loop()
 				if (!strncmp(ptr, "value", 5)) {
 					ptr += 6;
 					if (!strncmp(ptr, "false", 5)) {
-						is_frc = 0;
+						engine->is_frc = 0;
 					} else if (!strncmp(ptr, "true", 4)) {
-						is_frc = 1;
+						engine->is_frc = 1;
 					}
 				}
 			} else {
 				int found = 0;
-				struct SpinOption* curr = spin_options;
-				struct SpinOption* option_end = spin_options + arr_len(spin_options);
+				struct SpinOption const* curr = spin_options;
+				struct SpinOption const* option_end = spin_options + arr_len(spin_options);
 				for (; curr != option_end; ++curr) {
 					int len = strlen(curr->name);
 					if (!strncmp(ptr, curr->name, len)) {
@@ -231,23 +282,194 @@ void uci_loop()
 						if (!strncmp(ptr, "value", 5)) {
 							int value = strtoul(ptr + 6, &end, 10);
 							if (   value <= curr->max_val
-							    && value >= curr->min_val) {
-								curr->curr_val = value;
-								if (curr->handler)
-									curr->handler();
+							    && value >= curr->min_val)
+								engine->options[curr - spin_options] = value;
+						}
+					}
+				}
+#ifdef TUNE_BUILD
+				struct SearchTunable* curr_st = search_tunables;
+				struct SearchTunable* end_st  = search_tunables + NUM_SEARCH_TUNABLES;
+				for (; curr_st != end_st; ++curr_st) {
+					int len = strlen(curr_st->name);
+					if (   !strncmp(ptr, curr_st->name, len)
+					    &&  ptr[len] == ' ') {
+						found = 1;
+						if (!strncmp(ptr + len + 1, "value", 5)) {
+							int value = strtol(ptr + len + 7, &end, 10);
+							if (   value <= curr_st->max_val
+							    && value >= curr_st->min_val) {
+								*curr_st->val = value;
+								init_reductions();
 							}
 						}
 					}
 				}
+#endif
 				if (!found)
-					parse_eval_term(ptr, "value");
+					parse_eval_term(&eval_params, ptr, "value");
 			}
 
+		} else if (!strncmp(input, "bench", 5)) {
+
+			transition(su, WAITING);
+			bench(engine, strtoul(input + 5, &end, 10));
+
+		} else if (!strncmp(input, "seebench", 8)) {
+
+			transition(su, WAITING);
+			see_bench();
+
 		} else if (!strncmp(input, "perft", 5)) {
 
 			transition(su, WAITING);
 			performance_test(pos, atoi(input + 6));
 
+		} else if (!strncmp(input, "mate", 4)) {
+
+			transition(su, WAITING);
+			u32 moves = 0, mb = 64;
+			u64 nodes = 0;
+			ptr = strtok(input + 4, " \n");
+			if (ptr)
+				moves = strtoul(ptr, NULL, 10);
+			if (!moves) {
+				fprintf(stdout, "info string Usage: mate <moves> [nodes N] [hash MB]\n");
+				continue;
+			}
+			while ((ptr = strtok(NULL, " \n"))) {
+				if (!(end = strtok(NULL, " \n")))
+					break;
+				if (!strcmp(ptr, "nodes"))
+					nodes = strtoull(end, NULL, 10);
+				else if (!strcmp(ptr, "hash"))
+					mb = strtoull(end, NULL, 10) > 1048576 ? 1048576 : strtoul(end, NULL, 10);
+			}
+			mate_search(pos, moves, nodes, mb);
+
+		} else if (!strncmp(input, "tune", 4)) {
+
+			transition(su, WAITING);
+			ptr = input + min(strlen(input), 5);
+			end = strchr(ptr, ' ');
+			if (end)
+				*end++ = '\0';
+			if (!*ptr) {
+				fprintf(stdout, "info string Usage: tune <epd> [persona]\n");
+				continue;
+			}
+			tune(ptr, end && *end ? end : "tuned.txt", engine->options[THREADS]);
+			pt_clear(ctlr->pt);
+
+		} else if (!strncmp(input, "evalbatch", 9)) {
+
+			transition(su, WAITING);
+			ptr = input + min(strlen(input), 10);
+			end = strchr(ptr, ' ');
+			if (end)
+				*end++ = '\0';
+			if (!*ptr) {
+				fprintf(stdout, "info string Usage: evalbatch <in> [out]\n");
+				continue;
+			}
+			eval_batch(ptr, end && *end ? end : NULL, engine->options[THREADS]);
+
+		} else if (!strncmp(input, "pack", 4)) {
+
+			transition(su, WAITING);
+			ptr = input + min(strlen(input), 5);
+			end = strchr(ptr, ' ');
+			if (end)
+				*end++ = '\0';
+			if (!*ptr || !end || !*end) {
+				fprintf(stdout, "info string Usage: pack <in> <out>\n");
+				continue;
+			}
+			pack_file(ptr, end, engine->is_frc);
+
+		} else if (!strncmp(input, "gensfen", 7)) {
+
+			transition(su, WAITING);
+			struct GensfenParams params = { 100, 8, 0ULL, 8, 3000, (u64) time(NULL), engine->options[THREADS] };
+			char* out_path = strtok(input + min(strlen(input), 8), " \n");
+			if (!out_path) {
+				fprintf(stdout, "info string Usage: gensfen <out> [options]\n");
+				continue;
+			}
+			while ((ptr = strtok(NULL, " \n"))) {
+				if (!(end = strtok(NULL, " \n")))
+					break;
+				if (!strcmp(ptr, "games")) {
+					params.games = strtoul(end, NULL, 10);
+				} else if (!strcmp(ptr, "depth")) {
+					params.depth = min(strtoul(end, NULL, 10), MAX_PLY - 1);
+				} else if (!strcmp(ptr, "nodes")) {
+					params.nodes = strtoull(end, NULL, 10);
+					params.depth = MAX_PLY - 1;
+				} else if (!strcmp(ptr, "random")) {
+					params.random_plies = strtoul(end, NULL, 10);
+				} else if (!strcmp(ptr, "evallimit")) {
+					params.eval_limit = strtol(end, NULL, 10);
+				} else if (!strcmp(ptr, "seed")) {
+					params.seed = strtoull(end, NULL, 10);
+				}
+			}
+			gensfen(out_path, &params);
+
+		} else if (!strncmp(input, "match", 5)) {
+
+			transition(su, WAITING);
+			struct MatchParams params = { 100, 6, 0ULL, 0ULL, 8, 1000, 0, 0, 5, (u64) time(NULL), engine->options[THREADS] };
+			char* persona_a = strtok(input + 5, " \n");
+			char* persona_b = strtok(NULL, " \n");
+			if (!persona_a || !persona_b) {
+				fprintf(stdout, "info string Usage: match <personaA|-> <personaB|-> [options]\n");
+				continue;
+			}
+			// Options follow the two personae so that file names are never parsed as options
+			while ((ptr = strtok(NULL, " \n"))) {
+				if (!(end = strtok(NULL, " \n")))
+					break;
+				if (!strcmp(ptr, "games")) {
+					params.games = strtoul(end, NULL, 10);
+				} else if (!strcmp(ptr, "depth")) {
+					params.depth = min(strtoul(end, NULL, 10), MAX_PLY - 1);
+				} else if (!strcmp(ptr, "nodes")) {
+					params.nodes = strtoull(end, NULL, 10);
+					params.depth = MAX_PLY - 1;
+				} else if (!strcmp(ptr, "movetime")) {
+					params.movetime = strtoull(end, NULL, 10);
+					params.depth    = MAX_PLY - 1;
+				} else if (!strcmp(ptr, "random")) {
+					params.random_plies = strtoul(end, NULL, 10);
+				} else if (!strcmp(ptr, "evallimit")) {
+					params.eval_limit = strtol(end, NULL, 10);
+				} else if (!strcmp(ptr, "elo0")) {
+					params.elo0 = strtol(end, NULL, 10);
+					params.sprt = 1;
+				} else if (!strcmp(ptr, "elo1")) {
+					params.elo1 = strtol(end, NULL, 10);
+					params.sprt = 1;
+				} else if (!strcmp(ptr, "seed")) {
+					params.seed = strtoull(end, NULL, 10);
+				}
+			}
+			match(persona_a, persona_b, &params);
+
+		} else if (!strncmp(input, "serve", 5)) {
+
+			transition(su, WAITING);
+			struct ServeParams params = { 0ULL, 10000ULL };
+			ptr = strtok(input + 5, " \n");
+			while (ptr && (end = strtok(NULL, " \n"))) {
+				if (!strcmp(ptr, "nodes"))
+					params.max_nodes = strtoull(end, NULL, 10);
+				else if (!strcmp(ptr, "movetime"))
+					params.max_time = strtoull(end, NULL, 10);
+				ptr = strtok(NULL, " \n");
+			}
+			serve(engine, &params);
+
 		} else if (!strncmp(input, "ponderhit", 9)) {
 
 			ctlr->time_dependent = 1;
@@ -263,6 +485,8 @@ void uci_loop()
 			ctlr->time_left         = 240000;
 			ctlr->increment         = 0;
 			ctlr->analyzing         = 0;
+			ctlr->max_nodes         = 0;
+			ctlr->mate_moves        = 0;
 			su->limited_moves_num   = 0;
 
 			ptr = input;
@@ -295,6 +519,18 @@ void uci_loop()
 					ctlr->time_dependent = 0;
 					ptr = end;
 
+				} else if (!strncmp(ptr, "nodes", 5)) {
+
+					ctlr->max_nodes = strtoull(ptr + 6, &end, 10);
+					ctlr->time_dependent = 0;
+					ptr = end;
+
+				} else if (!strncmp(ptr, "mate", 4)) {
+
+					ctlr->mate_moves = (u32) strtoul(ptr + 5, &end, 10);
+					ctlr->time_dependent = 0;
+					ptr = end;
+
 				} else if (!strncmp(ptr, "movetime", 8)) {
 
 					ctlr->time_left  = strtoull(ptr + 9, &end, 10);
@@ -324,7 +560,7 @@ void uci_loop()
 						}
 						if (!legal_move(pos, move)) {
 							char mstr[6];
-							move_str(move, mstr);
+							move_str(pos, move, mstr);
 							fprintf(stdout, "Illegal move: %s\n", mstr);
 							break;
 						}
@@ -337,11 +573,17 @@ void uci_loop()
 				}
 			}
 
+			ctlr->input_time = after_position ? position_time : read_time;
+			if (ctlr->latency.estimate != ctlr->latency.reported) {
+				ctlr->latency.reported = ctlr->latency.estimate;
+				fprintf(stdout, "info string MoveOverhead %d ms plus measured latency %llu ms\n",
+					engine->options[MOVE_OVERHEAD], ctlr->latency.estimate);
+			}
 			start_thinking(su);
 
 		}
 	}
 cleanup_and_exit:
-	pthread_cond_destroy(&su->sleep_cv);
-	pthread_mutex_destroy(&su->mutex);
+	free(pos_cmd);
+	free(input);
 }
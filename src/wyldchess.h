@@ -0,0 +1,72 @@
+#ifndef WYLDCHESS_H
+#define WYLDCHESS_H
+
+/*
+ * WyldChess, a free UCI/Xboard compatible chess engine
+ * Copyright (C) 2016-2017 Manik Charan
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Interface of libwyldchess. Each engine has its own hash tables, search threads, options and position,
+// any number of them can search at the same time from different threads. Apart from wc_stop, an engine
+// is used by one thread at a time.
+
+struct Engine;
+
+// Limits of a search, 0 for none. A search without limits runs until wc_stop.
+struct WCLimits
+{
+	unsigned int depth;
+	unsigned long long nodes;
+	unsigned long long movetime;  // Milliseconds
+};
+
+// One line of a finished iteration, the score is from the point of view of the side to move
+struct WCInfo
+{
+	int depth;
+	int seldepth;
+	int multipv;   // Rank of the line, from 1
+	int score;     // Centipawns, when mate is 0
+	int mate;      // Moves until mate, negative when getting mated
+	unsigned long long nodes;
+	unsigned long long time;  // Milliseconds
+	char const* pv;           // Moves in UCI notation separated by spaces
+};
+
+// Returns NULL when out of memory
+extern struct Engine* wc_create(unsigned int hash_mb);
+extern void wc_destroy(struct Engine* engine);
+
+// Hash, Threads, MultiPV, MoveOverhead and UCI_Chess960(0 or 1), returns 0 for an unknown name or a value out of range
+extern int wc_set_option(struct Engine* engine, char const* name, int value);
+
+// Clears the hash table and the histories
+extern void wc_new_game(struct Engine* engine);
+
+// A NULL fen is the start position, moves are in UCI notation separated by spaces and may be NULL.
+// Returns NULL, or what is wrong with the position in which case the engine keeps the start position.
+extern char const* wc_set_position(struct Engine* engine, char const* fen, char const* moves);
+
+// Searches the position and calls info after each iteration, info may be NULL. Writes the best move,
+// "0000" when there are no legal moves, and returns its score: centipawns, or 29000 less the plies
+// to mate when mating and the negative of that when getting mated.
+extern int wc_search(struct Engine* engine, struct WCLimits const* limits,
+		     void (*info)(struct WCInfo const* info, void* data), void* data, char bestmove[6]);
+
+// Ends the search running on the engine, safe to call from any thread
+extern void wc_stop(struct Engine* engine);
+
+#endif
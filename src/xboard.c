@@ -19,45 +19,9 @@
 #include "defs.h"
 #include "search.h"
 #include "search_unit.h"
+#include "engine.h"
 #include "syzygy/tbprobe.h"
-#include "tt.h"
-#include "options.h"
-
-enum Result {
-	NO_RESULT,
-	DRAW,
-	CHECKMATE
-};
-
-static int three_fold_repetition(struct Position* const pos)
-{
-	struct State* curr = pos->state;
-	struct State* ptr  = curr - 2;
-	struct State* end  = curr - curr->fifty_moves;
-	if (end < pos->hist)
-		end = pos->hist;
-	u32 repeats = 0;
-	for (; ptr >= end; ptr -= 2)
-		if (ptr->pos_key == curr->pos_key)
-			++repeats;
-	return repeats >= 2;
-}
-
-static int check_stale_and_mate(struct Position* const pos)
-{
-	struct Movelist list;
-	list.end = list.moves;
-	set_pinned(pos);
-	set_checkers(pos);
-	gen_pseudo_legal_moves(pos, &list);
-	u32* move;
-	for (move = list.moves; move != list.end; ++move) {
-		if (!legal_move(pos, *move))
-			continue;
-		return NO_RESULT;
-	}
-	return pos->state->checkers_bb ? CHECKMATE : DRAW;
-}
+#include "packpos.h"
 
 static int check_result(struct Position* const pos)
 {
@@ -89,10 +53,10 @@ static int check_result(struct Position* const pos)
 	return result;
 }
 
-static inline void print_spin_option(struct SpinOption* option)
+static inline void print_spin_option(struct SpinOption const* option)
 {
 	fprintf(stdout, "feature option=\"%s -spin %d %d %d\"\n",
-			option->name, option->curr_val, option->min_val, option->max_val);
+			option->name, option->default_val, option->min_val, option->max_val);
 }
 
 static inline void print_options_xboard()
@@ -110,8 +74,8 @@ static inline void print_options_xboard()
 	fprintf(stdout, "feature time=1\n");
 	fprintf(stdout, "feature smp=1\n");
 	fprintf(stdout, "feature egt=syzygy\n");
-	struct SpinOption* curr = spin_options;
-	struct SpinOption* end  = spin_options + arr_len(spin_options);
+	struct SpinOption const* curr = spin_options;
+	struct SpinOption const* end  = spin_options + arr_len(spin_options);
 	for (; curr != end; ++curr)
 		print_spin_option(curr);
 	fprintf(stdout, "feature done=1\n");
@@ -121,9 +85,10 @@ void* su_loop_xboard(void* args)
 {
 	char mstr[6];
 	u32 move;
+	u64 stop_time;
 	struct SearchUnit* su   = (struct SearchUnit*) args;
 	struct Position* pos    = &su->pos;
-	struct Controller* ctlr = &controller;
+	struct Controller* ctlr = su->ctlr;
 	while (1) {
 		switch (su->target_state) {
 		case WAITING:
@@ -137,14 +102,17 @@ void* su_loop_xboard(void* args)
 		case THINKING:
 			su->curr_state = THINKING;
 			move = begin_search(su);
+			stop_time = curr_time();
 			su->target_state = WAITING;
-			move_str(move, mstr);
+			move_str(pos, move, mstr);
 			if (!legal_move(pos, move)) {
 				fprintf(stdout, "Invalid move by engine: %s\n", mstr);
 				pthread_exit(0);
 			}
 			do_move(pos, move);
 			fprintf(stdout, "move %s\n", mstr);
+			record_latency(&ctlr->latency, ctlr->search_start_time - ctlr->input_time
+						       + curr_time() - stop_time);
 			break;
 
 		case ANALYZING:
@@ -161,19 +129,19 @@ void* su_loop_xboard(void* args)
 	}
 }
 
-void xboard_loop()
+void xboard_loop(struct Engine* const engine)
 {
 	static int const max_len = 100;
 	char  input[max_len];
 	char* ptr;
 	char* end;
 	u32   move;
+	u64   read_time;  // A go or a move of the opponent starting a search counts towards its latency
 
-	struct SearchUnit* su = search_units;
-	init_search_unit(su);
+	struct SearchUnit* su   = engine->units[0];
+	struct Controller* ctlr = &engine->ctlr;
 	su->protocol = XBOARD;
 	struct Position* pos    = &su->pos;
-	struct Controller* ctlr = &controller;
 	su->game_over           = 0;
 	su->side                = BLACK;
 	ctlr->time_dependent    = 1;
@@ -183,12 +151,13 @@ void xboard_loop()
 	ctlr->time_left         = 240000;
 	ctlr->increment         = 0;
 
-	pthread_t* search_thread = search_threads;
+	pthread_t* search_thread = engine->threads;
 	pthread_create(search_thread, NULL, su_loop_xboard, (void*) su);
 	pthread_detach(*search_thread);
 
 	while (1) {
 		fgets(input, max_len, stdin);
+		read_time = curr_time();
 		input[strlen(input)-1] = '\0';
 		if (!strncmp(input, "protover 2", 10)) {
 
@@ -204,18 +173,15 @@ void xboard_loop()
 
 		} else if (!strncmp(input, "memory", 6)) {
 
-			tt_alloc_MB(&tt, strtoul(input + 7, &end, 10));
+			tt_alloc_MB(ctlr->tt, strtoul(input + 7, &end, 10));
 
 		} else if (!strncmp(input, "cores", 5)) {
 
-			struct SpinOption* option = spin_options + THREADS;
+			struct SpinOption const* option = spin_options + THREADS;
 			int value = strtoul(input + 6, &end, 10);
 			if (   value <= option->max_val
-			    && value >= option->min_val) {
-				option->curr_val = value;
-				if (option->handler)
-					option->handler();
-			}
+			    && value >= option->min_val)
+				engine->options[THREADS] = value;
 
 		} else if (!strncmp(input, "egtpath", 7)) {
 
@@ -229,8 +195,7 @@ void xboard_loop()
 
 			transition(su, WAITING);
 			su->game_over = 0;
-			init_search(&su->sl);
-			tt_clear(&tt);
+			wc_new_game(engine);
 			init_pos(pos);
 			set_pos(pos, INITIAL_POSITION);
 			su->side                 = BLACK;
@@ -245,7 +210,7 @@ void xboard_loop()
 
 			transition(su, WAITING);
 			transition(su, QUITTING);
-			goto cleanup_and_exit;
+			return;
 
 		} else if (!strncmp(input, "analyze", 7)) {
 
@@ -342,13 +307,41 @@ void xboard_loop()
 				check_result(pos);
 			else if (check_result(pos) != NO_RESULT)
 				su->game_over = 1;
-			else
+			else {
+				ctlr->input_time = read_time;
 				start_thinking(su);
+			}
+
+		} else if (!strncmp(input, "evalbatch", 9)) {
+
+			transition(su, WAITING);
+			ptr = input + min(strlen(input), 10);
+			end = strchr(ptr, ' ');
+			if (end)
+				*end++ = '\0';
+			if (!*ptr) {
+				fprintf(stdout, "info string Usage: evalbatch <in> [out]\n");
+				continue;
+			}
+			eval_batch(ptr, end && *end ? end : NULL, engine->options[THREADS]);
+
+		} else if (!strncmp(input, "pack", 4)) {
+
+			transition(su, WAITING);
+			ptr = input + min(strlen(input), 5);
+			end = strchr(ptr, ' ');
+			if (end)
+				*end++ = '\0';
+			if (!*ptr || !end || !*end) {
+				fprintf(stdout, "info string Usage: pack <in> <out>\n");
+				continue;
+			}
+			pack_file(ptr, end, engine->is_frc);
 
 		} else if (!strncmp(input, "eval", 4)) {
 
 			transition(su, WAITING);
-			fprintf(stdout, "evaluation = %d\n", evaluate(pos));
+			fprintf(stdout, "evaluation = %d\n", evaluate_pt(pos, ctlr->pt));
 			fprintf(stdout, "phase = %d\n", pos->phase);
 
 		} else if (!strncmp(input, "undo", 4)) {
@@ -363,8 +356,8 @@ void xboard_loop()
 		} else if (!strncmp(input, "option", 6)) {
 
 			ptr = input + 7;
-			struct SpinOption* curr = spin_options;
-			struct SpinOption* option_end = spin_options + arr_len(spin_options);
+			struct SpinOption const* curr = spin_options;
+			struct SpinOption const* option_end = spin_options + arr_len(spin_options);
 			for (; curr != option_end; ++curr) {
 				int len = strlen(curr->name);
 				if (!strncmp(ptr, curr->name, len)) {
@@ -372,11 +365,8 @@ void xboard_loop()
 					if (*ptr == '=') {
 						int value = strtol(ptr + 1, &end, 10);
 						if (   value <= curr->max_val
-						    && value >= curr->min_val) {
-							curr->curr_val = value;
-							if (curr->handler)
-								curr->handler();
-						}
+						    && value >= curr->min_val)
+							engine->options[curr - spin_options] = value;
 					}
 				}
 			}
@@ -404,14 +394,13 @@ void xboard_loop()
 				check_result(pos);
 			else if (check_result(pos) != NO_RESULT)
 				su->game_over = 1;
-			else if (su->side == pos->stm)
+			else if (su->side == pos->stm) {
+				ctlr->input_time = read_time;
 				start_thinking(su);
+			}
 			else if (ctlr->analyzing)
 				transition(su, ANALYZING);
 
 		}
 	}
-cleanup_and_exit:
-	pthread_cond_destroy(&su->sleep_cv);
-	pthread_mutex_destroy(&su->mutex);
 }